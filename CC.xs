@@ -18,3 +18,13 @@ PROTOTYPES: DISABLE
 
 BOOT:
   fmcc::boot(aTHX);
+
+void
+_set_background_pending(bool pending)
+  CODE:
+    fmcc::set_background_pending(pending);
+
+void
+_profile_update()
+  CODE:
+    fmcc::profile_update(aTHX);
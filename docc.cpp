@@ -1,8 +1,13 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <format>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -48,6 +53,7 @@ enum class CCDebugFlags {
     OpDump = 0x0400,     // u - dUmp the op tree before processing
     OpSeq =
         0x0800, // S - dump the op sequence number when printing op addresses
+    DumpIr = 0x1000, // i - dump the IV specialisation after each pass
 };
 
 using CCDebugBits = BitSet<CCDebugFlags>;
@@ -145,12 +151,20 @@ namespace {
 // the next fragment index to generate
 IV CodeIndex;
 
-typedef void (*fragment_handler)(pTHX_ const UNOP_AUX_item *aux);
+// returns the next op to run, or nullptr to continue after the
+// fragment
+typedef OP *(*fragment_handler)(pTHX_ const UNOP_AUX_item *aux);
 
-// the array of fragment handler function pointers once the module is built and
-// loaded.
-const fragment_handler *fragments;
-size_t fragment_count;
+// fragment handler function pointers, indexed by the fragment index,
+// filled in as each generated module is built and loaded.
+std::vector<fragment_handler> fragments;
+
+// fragments with an index below this have been included in a build,
+// successful or not
+size_t attempted_count;
+
+// a background build is running, see PERL_FMC_BACKGROUND
+bool background_pending;
 
 void
 init_debug_flags() {
@@ -194,6 +208,9 @@ init_debug_flags() {
             case 'S':
                 DebugFlags |= CCDebugFlags::OpSeq;
                 break;
+            case 'i':
+                DebugFlags |= CCDebugFlags::DumpIr;
+                break;
             }
             ++env;
         }
@@ -216,9 +233,11 @@ struct PadSv {
 // the OP (saved in aux) and fetch the correct SV via the OP,
 // whether it's still an OP_CONST or converted to OP_PADSV.
 //
-// Keeping an index should allow us to cache the generated code in the
-// future, since OP addresses will likely change, but the generated indexes
-// won't change unless the code changes.
+// Keeping an index rather than the OP address keeps the generated code
+// the same between runs, so it can be cached.
+//
+// Where a numeric constant is only used as a number it's written as a
+// C literal instead, see const_literal().
 
 struct OpConst {
     OpConst(size_t op_index_, OP *op_) : op_index(op_index_), op(op_) {}
@@ -245,74 +264,83 @@ struct StackSv {
     ssize_t offset; // PL_stack_sp[-offset]
 };
 
-// Represents an argument on the abstract stack
-using ArgType = std::variant<PadSv, OpConst, LocalSv, StackSv>;
-
-#if 0 // we may want this again later
-
-    /* An argument in NV form.
-       For constants this is ideally the number itself, otherwise it's
-       typically SvNV(sv of arg)
-
-       Currently unused but it may change if we can optimize some more
-       down the track.
-    */
-    struct RawNumber {
-        NV num = 0.0;
-    };
+// Raw C values, these are results of operations that are only used
+// as numbers, held in C local variables instead of being written to
+// the op's target SV.
+//
+// These are only generated when overloading is disabled, since
+// otherwise an operand might produce an object.  If the value does
+// need to be an SV (it's left on the stack, or passed to code that
+// needs an SV) it's stored in targ, the target of the op that
+// produced it, just as the op itself would have, or in a new mortal
+// if targ is zero.
 
-    using NumArg = std::variant<ArgType, RawNumber>;
+// an NV stored in a C local variable "NV nv%d"
+struct RawNv {
+    RawNv(int local_index_, PADOFFSET targ_)
+        : local_index(local_index_), targ(targ_) {}
+    RawNv() = delete;
+    int local_index;
+    PADOFFSET targ;
+};
 
-    NumArg
-    as_number(const OpConst &csv) {
-        SV *sv = cSVOPx_sv(csv.op);
-        return NumArg{RawNumber{SvNV(sv)}};
-    }
+// an IV stored in a C local variable "IV iv%d"
+struct RawIv {
+    RawIv(int local_index_, PADOFFSET targ_)
+        : local_index(local_index_), targ(targ_) {}
+    RawIv() = delete;
+    int local_index;
+    PADOFFSET targ;
+};
 
-    NumArg
-    as_number(const PadSv &psv) {
-        SV *sv = PAD_SV(psv.index);
-        // FIXME: what happens if the SV is AMAGICal? (can it happen?)
-        return SvREADONLY(sv) ? NumArg{RawNumber{SvNV(sv)}} : NumArg(psv);
-    }
+// a comparison result stored in a C local variable "bool b%d"
+// these become &PL_sv_yes or &PL_sv_no, so need no target
+struct RawBool {
+    RawBool(int local_index_) : local_index(local_index_) {}
+    RawBool() = delete;
+    int local_index;
+};
 
-    NumArg
-    as_number(const LocalSv &lsv) {
-        return NumArg{lsv};
-    }
+// Represents an argument on the abstract stack
+using ArgType =
+    std::variant<PadSv, OpConst, LocalSv, StackSv, RawNv, RawIv, RawBool>;
 
-    NumArg
-    as_number(const ArgType &arg) {
-        return
-            std::visit([](const auto &val){ return as_number(val); }, arg);
-    }
+inline bool
+is_raw(const ArgType &arg) {
+    return std::holds_alternative<RawNv>(arg) ||
+           std::holds_alternative<RawIv>(arg) ||
+           std::holds_alternative<RawBool>(arg);
+}
 
-    std::ostream &
-    operator <<(std::ostream &out, const RawNumber &num) {
-        // FIXME: need to ensure this is output with enough precision
-        out << num.num;
-        return out;
-    }
+// wrappers to format an argument as a C NV or IV expression
+// code << AsNv{arg} gives "nv3" for a RawNv and "SvNV(loc1)" for a LocalSv
+struct AsNv {
+    const ArgType &arg;
+};
 
-    std::ostream &
-    operator <<(std::ostream &out, const NumArg &arg) {
-        std::visit( overloaded {
-                [&]( const ArgType &a) { out << "SvNV(" << a << ")"; },
-                    [&]( const auto &a) { out << a; },
-                    }, arg);
-        return out;
-    }
+struct AsIv {
+    const ArgType &arg;
+};
 
-    std::ostream &
-    operator <<(std::ostream &out, const PadNv &arg) {
-    }
+// format an argument as a C truth test
+struct AsBool {
+    const ArgType &arg;
+};
 
-    // a result returned from a code fragment
-    struct CodeResult {
-        std::variant<PadSv, RawNumber> result;
-    };
+// format a unary operation on an NV, op is either a C operator or
+// the name of a function taking (pTHX_ NV)
+struct NvUnop {
+    std::string_view op;
+    const ArgType &arg;
+};
 
-#endif
+// format a binary operation on NVs, op is either a C operator or the
+// name of a function taking (pTHX_ NV, NV)
+struct NvBinop {
+    std::string_view op;
+    const ArgType &left;
+    const ArgType &right;
+};
 
 // abstraction of the perl value stack
 struct Stack {
@@ -346,6 +374,8 @@ struct Stack {
     std::vector<ArgType> stack;
     // number of values from the real perl stack
     ssize_t over_popped = 0;
+    // stack depths at each OP_PUSHMARK of a call in progress
+    std::vector<size_t> marks;
 };
 
 // code generation inserters for the various stack value variant types
@@ -441,7 +471,25 @@ operator<<(std::ostream &out, const OpConst &psv) {
 
 std::ostream &
 operator<<(std::ostream &out, const StackSv &ssv) {
-    out << "PL_stack_sp[" << ssv.offset << "]";
+    out << "PL_stack_sp[-" << ssv.offset << "]";
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const RawNv &nv) {
+    out << "nv" << nv.local_index;
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const RawIv &iv) {
+    out << "iv" << iv.local_index;
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const RawBool &b) {
+    out << "b" << b.local_index;
     return out;
 }
 
@@ -455,6 +503,62 @@ operator<<(std::ostream &out, const ArgType &arg) {
     return out;
 }
 
+std::ostream &
+operator<<(std::ostream &out, const AsNv &nv) {
+    std::visit(overloaded{
+                   [&](const RawNv &a) { out << a; },
+                   [&](const RawIv &a) { out << "(NV)" << a; },
+                   [&](const RawBool &a) { out << "(NV)" << a; },
+                   [&](const auto &a) { out << "SvNV(" << a << ")"; },
+               },
+               nv.arg);
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const AsIv &iv) {
+    std::visit(overloaded{
+                   [&](const RawNv &a) { out << "I_V(" << a << ")"; },
+                   [&](const RawIv &a) { out << a; },
+                   [&](const RawBool &a) { out << "(IV)" << a; },
+                   [&](const auto &a) { out << "SvIV(" << a << ")"; },
+               },
+               iv.arg);
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const AsBool &b) {
+    // NaN is true, as with SvTRUE()
+    std::visit(overloaded{
+                   [&](const RawNv &a) { out << "(" << a << " != 0.0)"; },
+                   [&](const RawIv &a) { out << "(" << a << " != 0)"; },
+                   [&](const RawBool &a) { out << a; },
+                   [&](const auto &a) { out << "SvTRUE(" << a << ")"; },
+               },
+               b.arg);
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const NvUnop &un) {
+    if (isALPHA(un.op[0]))
+        out << un.op << "(aTHX_ " << AsNv{un.arg} << ")";
+    else
+        out << un.op << AsNv{un.arg};
+    return out;
+}
+
+std::ostream &
+operator<<(std::ostream &out, const NvBinop &bin) {
+    if (isALPHA(bin.op[0]))
+        out << bin.op << "(aTHX_ " << AsNv{bin.left} << ", "
+            << AsNv{bin.right} << ")";
+    else
+        out << AsNv{bin.left} << " " << bin.op << " " << AsNv{bin.right};
+    return out;
+}
+
 std::ostream &
 operator<<(std::ostream &out, const Stack &s) {
     for (auto i : s.stack) {
@@ -473,22 +577,63 @@ struct CodeFragment;
 
 CodeFragment &operator<<(CodeFragment &os, auto const &v);
 
+std::optional<ArgType> const_literal(pTHX_ CodeFragment &code, OP *o);
+
 // Used to generate code for an op tree fragment
 struct CodeFragment {
-    CodeFragment(pTHX_ const COP *cop, OP *next_op)
-        : line(CopLINE(cop)), file(CopFILE(cop)),
+    CodeFragment(pTHX_ const COP *cop, OP *next_op, bool quiet_ = false)
+        : line(CopLINE(cop)), file(CopFILE(cop)), cop(cop),
           overloading((CopHINTS_get(cop) & HINT_NO_AMAGIC) == 0),
-          use_float(cop_bool_config(aTHX_ cop, "Faster::Maths::CC/float")) {
-        ops.push_back(next_op);
-        *this << "// " << CopFILE(cop) << ":" << CopLINE(cop) << '\n';
+          use_float(cop_bool_config(aTHX_ cop, "Faster::Maths::CC/float")),
+          quiet(quiet_) {
+        // aux[1], where the fragment continues
+        UNOP_AUX_item next;
+        next.pv = reinterpret_cast<char *>(next_op);
+        aux.push_back(next);
+        declare("// ", CopFILE(cop), ":", CopLINE(cop), '\n');
+    }
+    // add to the declarations at the top of the generated function
+    void
+    declare(auto const &...v) {
+        (prologue << ... << v);
+        if (DebugFlags(CCDebugFlags::DumpCode) && !quiet)
+            (std::cerr << ... << v);
+    }
+    // save an op in the aux block, returning its index,
+    // the generated code can access it as (OP *)aux[index].pv
+    size_t
+    save_aux_op(OP *op) {
+        UNOP_AUX_item item;
+        item.pv = reinterpret_cast<char *>(op);
+        return save_aux(item);
+    }
+    // save a value computed while generating code in the aux block,
+    // the generated code can access it as aux[index].uv
+    size_t
+    save_aux_uv(UV uv) {
+        UNOP_AUX_item item;
+        item.uv = uv;
+        return save_aux(item);
+    }
+    size_t
+    save_aux(const UNOP_AUX_item &item) {
+        uses_aux = true;
+        size_t index = 1 + aux.size();
+        aux.push_back(item);
+        return index;
     }
     // save an op containing a constant and return an appropriate
     // "argument" value
     OpConst
     save_const_op(OP *op) {
-        size_t index = 1 + ops.size();
-        ops.push_back(op);
-        return OpConst{index, op};
+        return OpConst{save_aux_op(op), op};
+    }
+    // update the hints we generate code for from a COP within the
+    // fragment
+    void
+    set_cop(pTHX_ const COP *cop) {
+        overloading = (CopHINTS_get(cop) & HINT_NO_AMAGIC) == 0;
+        use_float = cop_bool_config(aTHX_ cop, "Faster::Maths::CC/float");
     }
     LocalSv
     make_local_sv() {
@@ -498,39 +643,189 @@ struct CodeFragment {
     get_local_sv(const PadSv &psv) {
         auto search = pad_locals.find(psv.index);
         if (search == pad_locals.end()) {
+            uses_pad = true;
             auto loc = make_local_sv();
             pad_locals.emplace(psv.index, loc.local_index);
-            *this << "SV *" << loc << " = " << psv << ";\n";
+            // pad entries don't change during a call, so fetch them
+            // once at the top of the function, this also keeps them
+            // in scope for any loops
+            declare("SV *", loc, " = ", psv, ";\n");
             return loc;
         } else {
             return LocalSv{search->second};
         }
     }
+    // the value of a pad entry, a leaf sub's parameters are NVs
+    ArgType
+    pad_value(PADOFFSET index) {
+        auto param = leaf_params.find(index);
+        if (param != leaf_params.end())
+            return RawNv{param->second, index};
+        return PadSv{index};
+    }
+    RawNv
+    make_raw_nv(PADOFFSET targ) {
+        return RawNv{local_count++, targ};
+    }
+    RawIv
+    make_raw_iv(PADOFFSET targ) {
+        return RawIv{local_count++, targ};
+    }
+    RawBool
+    make_raw_bool() {
+        return RawBool{local_count++};
+    }
+    // store a raw value in an SV, returning that SV
+    LocalSv
+    box_raw(const ArgType &arg) {
+        return std::visit(
+            overloaded{
+                [&](const RawNv &nv) {
+                    if (!nv.targ) {
+                        auto out = make_local_sv();
+                        *this << "SV *" << out << " = sv_2mortal(newSVnv("
+                              << nv << "));\n";
+                        return out;
+                    }
+                    auto out = get_local_sv(PadSv{nv.targ});
+                    *this << "fast_sv_setnv(aTHX_ " << out << ", " << nv
+                          << ");\n";
+                    return out;
+                },
+                [&](const RawIv &iv) {
+                    if (!iv.targ) {
+                        auto out = make_local_sv();
+                        *this << "SV *" << out << " = sv_2mortal(newSViv("
+                              << iv << "));\n";
+                        return out;
+                    }
+                    auto out = get_local_sv(PadSv{iv.targ});
+                    *this << "fast_sv_setiv(aTHX_ " << out << ", " << iv
+                          << ");\n";
+                    return out;
+                },
+                [&](const RawBool &b) {
+                    auto out = make_local_sv();
+                    *this << "SV *" << out << " = boolSV(" << b << ");\n";
+                    return out;
+                },
+                [&](const auto &) -> LocalSv {
+                    croak("box_raw() called on a non-raw value");
+                },
+            },
+            arg);
+    }
     // simplify an argument into a LocalSv if it's a PadSv to
-    // save PAD_SV() calls
+    // save PAD_SV() calls, raw values are stored into an SV
     ArgType
     simplify_val(const ArgType &arg) {
         if (std::holds_alternative<PadSv>(arg)) {
             return ArgType{get_local_sv(std::get<PadSv>(arg))};
+        } else if (is_raw(arg)) {
+            return ArgType{box_raw(arg)};
         } else
             return arg;
     }
+    // simplify an argument that's only going to be used as a number,
+    // raw values are left alone, numeric constants become raw values
+    // the C compiler can fold, and loop invariant variables become the
+    // values read before the loop
+    ArgType
+    simplify_num(const ArgType &arg) {
+        if (is_raw(arg))
+            return arg;
+        if (auto psv = std::get_if<PadSv>(&arg)) {
+            auto inv = invariants.find(psv->index);
+            if (inv != invariants.end()) {
+                if (std::find(invariants_used.begin(), invariants_used.end(),
+                              psv->index) == invariants_used.end())
+                    invariants_used.push_back(psv->index);
+                return inv->second;
+            }
+        }
+        if (auto c = std::get_if<OpConst>(&arg)) {
+            dTHX;
+            if (auto lit = const_literal(aTHX_ *this, c->op))
+                return *lit;
+        }
+        return simplify_val(arg);
+    }
+    // a raw value computed earlier by key, the type and C expression
+    // that computed it, such as "NV nv2 * nv2", which only uses other
+    // raw values so always computes the same value
+    const ArgType *
+    find_shared(const std::string &key) const {
+        for (auto &[k, v] : shared) {
+            if (k == key)
+                return &v;
+        }
+        return nullptr;
+    }
+    void
+    add_shared(std::string key, const ArgType &value) {
+        shared.emplace_back(std::move(key), value);
+    }
+    // generate code with gen() into a separate buffer, returning the
+    // code so it can be placed after code generated later, such as
+    // the branches of a conditional.  The code is dumped when it's
+    // placed.
+    //
+    // The captured code is placed within a block, so values it
+    // computes can't be shared with code after it.
+    std::string
+    capture(auto &&gen) {
+        std::ostringstream saved;
+        std::swap(code, saved);
+        auto shared_before = shared;
+        ++capturing;
+        gen();
+        --capturing;
+        shared = std::move(shared_before);
+        std::swap(code, saved);
+        return saved.str();
+    }
 
-    std::ostringstream code; // generated code
-    std::vector<OP *> ops;   // ops to be saved in the aux block
+    std::ostringstream prologue; // generated declarations
+    std::ostringstream code;     // generated code
+    std::vector<UNOP_AUX_item> aux; // items for the aux block
     bool overloading;        // is overloading enabled?
     bool use_float;          // prefer floating point
 
     // hash-in-perl-speak of PadSvs we've made locals for
     my_map<PADOFFSET, int> pad_locals;
+    // raw values that later code can use instead of computing them
+    // again, see find_shared()
+    std::vector<std::pair<std::string, ArgType>> shared;
     // CodeResult result;
     //  code fragment source line extracted from the COP used to
     //  generate the function "// file:line" header
     line_t line = 0;
     const char *file = 0;
+    // the statement the fragment starts in
+    const COP *cop;
 
     // number of generated local variables
     int local_count = 0;
+    // number of loops generated, used to make unique labels
+    int loop_count = 0;
+    // don't dump the code, used when checking if we can compile code
+    bool quiet = false;
+    // code is being captured, it's dumped when it's placed
+    int capturing = 0;
+
+    // the sub when compiling a leaf sub, see compile_leaf()
+    CV *leaf_cv = nullptr;
+    // pad indexes of the leaf sub's parameters to their NV locals
+    my_map<PADOFFSET, int> leaf_params;
+    // variables the loop being generated doesn't change, to the raw
+    // values read from them before the loop, and the ones used as
+    // numbers, see compile_loop()
+    my_map<PADOFFSET, ArgType> invariants;
+    std::vector<PADOFFSET> invariants_used;
+    // the generated code uses the pad or the aux block, which a leaf
+    // sub doesn't have
+    bool uses_pad = false;
+    bool uses_aux = false;
 
     // don't allow copying or moving, though this may change
     CodeFragment(CodeFragment const &) = delete;
@@ -544,7 +839,7 @@ struct CodeFragment {
 CodeFragment &
 operator<<(CodeFragment &os, auto const &v) {
     os.code << v;
-    if (DebugFlags(CCDebugFlags::DumpCode))
+    if (DebugFlags(CCDebugFlags::DumpCode) && !os.quiet && !os.capturing)
         std::cerr << v;
     return os;
 }
@@ -560,40 +855,171 @@ oCCOP_SKIP(OP *o) {
     return (OP *)aux[1].pv;
 }
 
+// call a Faster::Maths::CC sub, warning rather than dying if it fails
+void
+call_fmc(pTHX_ const char *name, const char *what) {
+    dSP;
+    ENTER;
+    SAVETMPS;
+    // don't disturb the caller's $@
+    save_scalar(PL_errgv);
+    PUSHMARK(SP);
+    PUTBACK;
+    call_pv(name, G_DISCARD | G_NOARGS | G_EVAL);
+    if (SvTRUE(ERRSV))
+        warn("Faster::Maths::CC: %s: %" SVf, what, SVfARG(ERRSV));
+    FREETMPS;
+    LEAVE;
+}
+
+// build fragments generated after CHECK time, eg. by require or
+// string eval, into another module.
+//
+// This is only done at run time, code run before then is left to the
+// CHECK time build, and each fragment is only included in one build
+// attempt.
+//
+// returns true if the fragment at index is now available
+bool
+build_late_fragments(pTHX_ UV index) {
+    static bool building = false;
+    if (PL_phase != PERL_PHASE_RUN || index < attempted_count || building)
+        return false;
+    attempted_count = CodeIndex;
+    building = true;
+    call_fmc(aTHX_ "Faster::Maths::CC::build_late",
+             "could not build late fragments");
+    building = false;
+
+    return index < fragments.size() && fragments[index];
+}
+
+// load any finished background builds.
+//
+// Checking means a trip through perl code and a system call or two,
+// so it's only done every so often, keeping the fallback to the
+// original OPs cheap while the build runs.
+//
+// returns true if the fragment at index is now available
+bool
+poll_background(pTHX_ UV index) {
+    using clock = std::chrono::steady_clock;
+    static clock::time_point next_poll;
+    static bool polling = false;
+    auto now = clock::now();
+    if (polling || now < next_poll)
+        return false;
+    next_poll = now + std::chrono::milliseconds(100);
+    polling = true;
+    call_fmc(aTHX_ "Faster::Maths::CC::poll_background",
+             "could not load background build");
+    polling = false;
+
+    return index < fragments.size() && fragments[index];
+}
+
+// type profiling, see PERL_FMC_PROFILE
+//
+// For each fragment with an IV specialisation, the kinds of value its
+// inputs had on each call are counted, whether the generated code or
+// the original ops ran.  At END the counts are merged into
+// %Faster::Maths::CC::profile and written to the profile file, and a
+// later run uses them to decide which fragments to specialise.
+bool profiling;
+
+// the kinds of value counted, the names are used in the profile
+enum class ProfileKind { Iv, Nv, Pv, Ref, Magic, Undef, Other, Count };
+
+const char *const profile_kind_names[] = {"iv",    "nv",    "pv",   "ref",
+                                          "magic", "undef", "other"};
+
+// classify an SV for the profile, "iv" matches guard_iv_read() in
+// header.c
+ProfileKind
+profile_kind(SV *sv) {
+    U32 flags = SvFLAGS(sv);
+    if (flags & SVs_GMG)
+        return ProfileKind::Magic;
+    if (flags & SVf_ROK)
+        return ProfileKind::Ref;
+    if (flags & SVf_POK)
+        return ProfileKind::Pv;
+    if ((flags & (SVf_IVisUV | SVf_IOK | SVf_NOK)) == SVf_IOK)
+        return ProfileKind::Iv;
+    if (flags & SVf_NOK)
+        return ProfileKind::Nv;
+    if (!(flags & SVf_OK))
+        return ProfileKind::Undef;
+    return ProfileKind::Other;
+}
+
+// an input of a fragment, a pad entry or a value from the perl stack
+struct ProfileInput {
+    bool stack = false;
+    ssize_t index = 0; // pad index, or offset from PL_stack_sp
+    UV counts[static_cast<size_t>(ProfileKind::Count)] = {};
+};
+
+struct ProfileFragment {
+    std::string file;
+    line_t line = 0;
+    std::vector<ProfileInput> inputs;
+};
+
+// indexed by fragment index
+std::vector<ProfileFragment> profile_fragments;
+
+// count the kinds of the inputs to fragment index, called before it
+// runs
+void
+profile_fragment(pTHX_ UV index) {
+    if (index >= profile_fragments.size())
+        return;
+    for (auto &input : profile_fragments[index].inputs) {
+        SV *sv = input.stack ? PL_stack_sp[-input.index] : PAD_SV(input.index);
+        ++input.counts[static_cast<size_t>(profile_kind(sv))];
+    }
+}
+
 // ppfunc for our ops
 OP *
 pp_callcompiled(pTHX) {
     // op_next points to the op tree fragment we're generating this
     // C code fragment from, so NORMAL will be sane when we don't have
     // compiled code to run yet
-    if (fragments == nullptr) {
-        debugln("could not run {} not generated", OpPtr{PL_op});
-        return NORMAL; // use the old
-    }
     const UNOP_AUX_item *aux = cUNOP_AUX->op_aux;
     UV index = aux[0].uv;
-    if (index >= fragment_count) {
-        debugln("could not run {} high index {}", OpPtr{PL_op}, index);
+    if (profiling)
+        profile_fragment(aTHX_ index);
+    if ((index >= fragments.size() || !fragments[index]) &&
+        !(background_pending && poll_background(aTHX_ index)) &&
+        !build_late_fragments(aTHX_ index)) {
+        debugln("could not run {} index {} not generated", OpPtr{PL_op},
+                index);
         return NORMAL; // use the old
     }
 
     logln(CCDebugFlags::TraceFrags, "calling fragment {}", index);
-    fragments[index](aTHX_ aux);
+    OP *next = fragments[index](aTHX_ aux);
 
-    // skip the old op tree
-    return (OP *)aux[1].pv; // umm
+    // skip the old op tree, unless the fragment wants to go elsewhere
+    return next ? next : (OP *)aux[1].pv; // umm
 }
 
-// given generated code finish it up:
-// - generate code:
-//   - to pop consumed stack
-//   - push return values
-//   - function definition header and trailer
-// - save it generated code to @collection for later use
-// - build the OP and insert it into the OP tree
+// is o within the op tree rooted at ancestor?
+bool
+op_within(OP *o, const OP *ancestor) {
+    for (; o; o = op_parent(o)) {
+        if (o == ancestor)
+            return true;
+    }
+    return false;
+}
+
+// generate code to pop the values the fragment consumed from the perl
+// stack and push its results
 void
-code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
-              OP *prev) {
+push_results(CodeFragment &code, Stack &stack) {
     // FIXME: if we're pushing something we popped this will free it
     // and then try to use it for reference counted stack builds
     // which would be bad
@@ -601,6 +1027,12 @@ code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
         code << "rpp_popfree_to(PL_stack_sp-" << stack.over_popped << ");\n";
     }
 
+    // anything left on the stack needs to be an SV
+    for (auto &item : stack) {
+        if (is_raw(item))
+            item = code.box_raw(item);
+    }
+
     // generate code to push any result SVs
     if (stack.size() != 0)
         code << "rpp_extend(" << stack.size() << ");\n";
@@ -608,15 +1040,28 @@ code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
         // this may need to change
         code << "rpp_push_1(" << item << ");\n";
     }
+}
+
+// given generated code finish it up:
+// - generate code:
+//   - to pop consumed stack
+//   - push return values
+//   - function definition header and trailer
+// - save it generated code to @collection for later use
+// - build the OP and insert it into the OP tree
+void
+code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
+              OP *prev) {
+    push_results(code, stack);
 
     // wrap the generated code with a function definition
     IV index = CodeIndex++;
-    SV *out = Perl_newSVpvf(aTHX_ "static void\nf%" UVf "(pTHX_ "
+    SV *out = Perl_newSVpvf(aTHX_ "static OP *\nf%" UVf "(pTHX_ "
                                   "const UNOP_AUX_item *aux) {\n",
                             index);
-    std::string codestring = code.code.str();
+    std::string codestring = code.prologue.str() + code.code.str();
     sv_catpvn(out, codestring.c_str(), codestring.size());
-    sv_catpvs(out, "}\n");
+    sv_catpvs(out, "return NULL;\n}\n");
 
     // populate @collection with the various bits
     SV *func = Perl_newSVpvf(aTHX_ "f%" UVf, index);
@@ -635,19 +1080,26 @@ code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
     debugln("Performing OP replacement");
 
     UNOP_AUX_item *aux;
-    Newx(aux, 1 + code.ops.size(), UNOP_AUX_item);
+    Newx(aux, 1 + code.aux.size(), UNOP_AUX_item);
     aux[0].iv = index;
-    size_t op_index = 1;
-    for (auto op : code.ops) {
-        aux[op_index++].pv = (char *)op; // booo!
-    }
-    OP *retop = newUNOP_AUX(OP_CUSTOM, 0, NULL, aux);
+    std::copy(code.aux.begin(), code.aux.end(), aux + 1);
+    // overload handlers and other code called from the fragment take
+    // their context from this op, as they would from the ops it
+    // replaces, rather than from the enclosing block
+    OP *retop = newUNOP_AUX(OP_CUSTOM, OPf_WANT_SCALAR, NULL, aux);
 
     // we want this between the final and it's previous sibling
     retop->op_ppaddr = &pp_callcompiled;
     retop->op_next = start;
+    // nothing for perl's peephole optimizer to do, and see
+    // rpeep_for_callcompiled()
+    retop->op_opt = 1;
 
+    // the closest op containing both start and final, final may be
+    // within a branch of a conditional that start is outside of
     OP *parent = op_parent(final);
+    while (parent && !op_within(start, parent))
+        parent = op_parent(parent);
 
     // find the op to put this after, scan up from start until we see parent
     OP *scan = start;
@@ -682,11 +1134,17 @@ code_finalize(pTHX_ CodeFragment &code, Stack &stack, OP *start, OP *final,
     }
 }
 
+// can o write directly to a lexical variable instead of its target?
+inline bool
+is_mutator(const OP *o) {
+    return (PL_opargs[o->op_type] & OA_TARGLEX) &&
+           (o->op_private & OPpTARGET_MY);
+}
+
 ArgType
 binop_normal(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
              const ArgType &out, const ArgType &left, const ArgType &right) {
-    bool mutator =
-        (PL_opargs[o->op_type] & OA_TARGLEX) && (o->op_private & OPpTARGET_MY);
+    bool mutator = is_mutator(o);
 
     // the result might be in out, or it might be in a mortal
     // so just some SV
@@ -704,8 +1162,7 @@ binop_normal(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
 ArgType
 binop_ovfloat(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
               const ArgType &out, const ArgType &left, const ArgType &right) {
-    bool mutator =
-        (PL_opargs[o->op_type] & OA_TARGLEX) && (o->op_private & OPpTARGET_MY);
+    bool mutator = is_mutator(o);
     // the result might be left, out, or it might be in a mortal
     // so just some SV
     ArgType result = code.make_local_sv();
@@ -727,31 +1184,378 @@ binop_noov(pTHX_ std::string_view opname, CodeFragment &code,
     return out;
 }
 
+// declare a raw value of type ctype ("NV", "IV" or "bool") computed
+// by expr, with targ as its target.
+//
+// If share is set expr only uses raw values, so an earlier identical
+// expression computed the same value, and that value is returned
+// instead.  It gets targ as its own target, so each op's result is
+// still boxed into that op's target.
+ArgType
+declare_raw(CodeFragment &code, std::string_view ctype, PADOFFSET targ,
+            const std::string &expr, bool share) {
+    std::string key = std::string(ctype) + " " + expr;
+    if (share) {
+        if (auto found = code.find_shared(key)) {
+            return std::visit(
+                overloaded{
+                    [&](const RawNv &nv) -> ArgType {
+                        return RawNv{nv.local_index, targ};
+                    },
+                    [&](const RawIv &iv) -> ArgType {
+                        return RawIv{iv.local_index, targ};
+                    },
+                    [&](const auto &) { return *found; },
+                },
+                *found);
+        }
+    }
+    ArgType result = ctype == "NV"   ? ArgType{code.make_raw_nv(targ)}
+                     : ctype == "IV" ? ArgType{code.make_raw_iv(targ)}
+                                     : ArgType{code.make_raw_bool()};
+    code << ctype << " " << result << " = " << expr << ";\n";
+    if (share)
+        code.add_shared(std::move(key), result);
+    return result;
+}
+
+// does reading arg as a number read an SV, which may call magic?
+bool
+reads_sv(const ArgType &arg) {
+    return std::holds_alternative<PadSv>(arg) ||
+           std::holds_alternative<LocalSv>(arg) ||
+           std::holds_alternative<StackSv>(arg);
+}
+
+// C doesn't specify the order function arguments, or the operands of
+// most operators, are evaluated in.  If both operands read SVs read
+// left into a C local of type ctype first, so any magic is called in
+// the same order as perl would.
+ArgType
+read_left_first(CodeFragment &code, std::string_view ctype,
+                const ArgType &left, const ArgType &right) {
+    if (!reads_sv(left) || !reads_sv(right))
+        return left;
+    std::ostringstream expr;
+    if (ctype == "NV")
+        expr << AsNv{left};
+    else
+        expr << AsIv{left};
+    return declare_raw(code, ctype, 0, expr.str(), false);
+}
+
+// what's certain about an argument used as a number, see num_type()
+enum class NumType {
+    Unknown, // any SV, which may be a string, magic or overloaded
+    Iv,      // an IV, or a bool
+    Nv,      // an NV, which perl treats as an IV if it's an integer
+    Frac,    // an NV perl never treats as an IV, since it isn't an
+             // integer, or is an infinity or NaN
+};
+
+// infer the numeric type of arg
+//
+// Raw values have the type of their C variable, and constants that
+// of the value perl compiled.  Neither can be magic or overloaded.
+NumType
+num_type(pTHX_ const ArgType &arg) {
+    return std::visit(
+        overloaded{
+            [](const RawIv &) { return NumType::Iv; },
+            [](const RawBool &) { return NumType::Iv; },
+            [](const RawNv &) { return NumType::Nv; },
+            [&](const OpConst &c) {
+                SV *sv = cSVOPx_sv(c.op);
+                if (!sv || (SvFLAGS(sv) & (SVs_GMG | SVf_ROK | SVf_POK)))
+                    return NumType::Unknown;
+                if (SvNOK(sv) && !SvIOK(sv)) {
+                    NV nv = SvNVX(sv);
+                    return Perl_isnan(nv) || Perl_isinf(nv) ||
+                                   nv != Perl_floor(nv)
+                               ? NumType::Frac
+                               : NumType::Nv;
+                }
+                if (SvIOK(sv) && !SvNOK(sv) && !SvIsUV(sv))
+                    return NumType::Iv;
+                return NumType::Unknown;
+            },
+            [](const auto &) { return NumType::Unknown; },
+        },
+        arg);
+}
+
+// is the result of o certain to be an NV, so it can be computed as C
+// NVs without "+float"?  Only for + - * /, since % and ** use integers
+// even for some NV operands.
+//
+// Perl only uses integer arithmetic if both operands are integers,
+// so with a Frac operand the result is the NV arithmetic on the two
+// numeric values.  The other operand may be any SV if overloading
+// is disabled, other than the lvalue of "+=" and friends, which
+// treat undef specially.  Division only when the divisor is the
+// Frac, since perl croaks for zero.
+bool
+certain_nv_binop(pTHX_ OP *o, const CodeFragment &code, const ArgType &left,
+                 const ArgType &right) {
+    switch (o->op_type) {
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+        break;
+    default:
+        return false;
+    }
+    auto ltype = num_type(aTHX_ left);
+    auto rtype = num_type(aTHX_ right);
+    if (o->op_type == OP_DIVIDE ? rtype != NumType::Frac
+                                : ltype != NumType::Frac &&
+                                      rtype != NumType::Frac)
+        return false;
+    auto other = ltype == NumType::Frac ? rtype : ltype;
+    return other != NumType::Unknown ||
+           (!code.overloading && !(o->op_flags & OPf_STACKED));
+}
+
+// how a comparison of left and right can be done in C without
+// "+float", as IVs, as NVs, or Unknown if it can't be
+//
+// Perl compares as integers if both operands are integers, which is
+// exact for IVs, and the same as comparing as NVs for integer NVs.
+// An integer constant is also exact as an NV while it fits in the
+// mantissa.  With a Frac operand perl always compares as NVs, so
+// the other may be any SV if overloading is disabled.
+NumType
+cmp_type(pTHX_ const CodeFragment &code, const ArgType &left,
+         const ArgType &right) {
+    auto ltype = num_type(aTHX_ left);
+    auto rtype = num_type(aTHX_ right);
+    if (ltype == NumType::Frac || rtype == NumType::Frac) {
+        return (ltype != NumType::Unknown && rtype != NumType::Unknown) ||
+                       !code.overloading
+                   ? NumType::Nv
+                   : NumType::Unknown;
+    }
+    if (ltype == NumType::Unknown || rtype == NumType::Unknown)
+        return NumType::Unknown;
+    if (ltype == rtype)
+        return ltype;
+    // an IV and an NV
+    auto &iv = ltype == NumType::Iv ? left : right;
+    auto c = std::get_if<OpConst>(&iv);
+    if (!c)
+        return NumType::Unknown;
+    IV value = SvIVX(cSVOPx_sv(c->op));
+    IV limit = static_cast<IV>(1) << (NV_MANT_DIG < 63 ? NV_MANT_DIG : 62);
+    return value > -limit && value < limit ? NumType::Nv : NumType::Unknown;
+}
+
+// with float and no overloading the result is only ever an NV, so
+// keep it as a C NV unless it's being assigned to a variable
 ArgType
-binop_float(pTHX_ std::string_view op, CodeFragment &code, const ArgType &out,
+binop_float(pTHX_ OP *o, std::string_view op, CodeFragment &code,
             const ArgType &left, const ArgType &right) {
-    code << "fast_sv_setnv(aTHX_ " << out << ", SvNV(" << left << ") " << op
-         << " SvNV(" << right << "));\n";
-    return out;
+    bool mutator = is_mutator(o);
+    if (mutator || (o->op_flags & OPf_STACKED)) {
+        auto out = o->op_flags & OPf_STACKED
+                       ? code.simplify_val(left)
+                       : code.simplify_val(PadSv{o->op_targ});
+        auto first = read_left_first(code, "NV", left, right);
+        code << "fast_sv_setnv(aTHX_ " << out << ", "
+             << NvBinop{op, first, right} << ");\n";
+        return out;
+    }
+
+    auto first = read_left_first(code, "NV", left, right);
+    std::ostringstream expr;
+    expr << NvBinop{op, first, right};
+    return declare_raw(code, "NV", o->op_targ, expr.str(),
+                       is_raw(first) && is_raw(right));
+}
+
+// without overloading "use integer" ops only produce IVs, so keep the
+// result as a C IV unless it's being assigned to a variable
+ArgType
+binop_int(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
+          const ArgType &left, const ArgType &right) {
+    bool mutator = is_mutator(o);
+    if (mutator || (o->op_flags & OPf_STACKED)) {
+        auto out = o->op_flags & OPf_STACKED
+                       ? code.simplify_val(left)
+                       : code.simplify_val(PadSv{o->op_targ});
+        auto first = read_left_first(code, "IV", left, right);
+        code << "fast_sv_setiv(aTHX_ " << out << ", " << opname
+             << "_raw(aTHX_ " << AsIv{first} << ", " << AsIv{right}
+             << "));\n";
+        return out;
+    }
+
+    auto first = read_left_first(code, "IV", left, right);
+    std::ostringstream expr;
+    expr << opname << "_raw(aTHX_ " << AsIv{first} << ", " << AsIv{right}
+         << ")";
+    return declare_raw(code, "IV", o->op_targ, expr.str(),
+                       is_raw(first) && is_raw(right));
 }
 
 // generate code for a binop
 void
 add_binop(pTHX_ OP *o, CodeFragment &code, Stack &stack,
           std::string_view opname, std::string_view op) {
-    auto right = code.simplify_val(stack.pop());
-    auto left = code.simplify_val(stack.pop());
-    auto out =
-        o->op_flags & OPf_STACKED ? left : code.simplify_val(PadSv{o->op_targ});
+    ArgType result = PadSv{o->op_targ};
+    auto right = stack.pop();
+    auto left = stack.pop();
+    if ((!code.overloading && code.use_float) ||
+        certain_nv_binop(aTHX_ o, code, left, right)) {
+        right = code.simplify_num(right);
+        left = code.simplify_num(left);
+        result = binop_float(aTHX_ o, op, code, left, right);
+    } else {
+        right = code.simplify_val(right);
+        left = code.simplify_val(left);
+        auto out = o->op_flags & OPf_STACKED
+                       ? left
+                       : code.simplify_val(PadSv{o->op_targ});
 
-    ArgType result =
-        code.overloading
-            ? (code.use_float
-                   ? binop_ovfloat(aTHX_ o, opname, code, out, left, right)
-                   : binop_normal(aTHX_ o, opname, code, out, left, right))
-            : (code.use_float
-                   ? binop_float(aTHX_ op, code, out, left, right)
-                   : binop_noov(aTHX_ opname, code, out, left, right));
+        result =
+            code.overloading
+                ? (code.use_float
+                       ? binop_ovfloat(aTHX_ o, opname, code, out, left, right)
+                       : binop_normal(aTHX_ o, opname, code, out, left, right))
+                : binop_noov(aTHX_ opname, code, out, left, right);
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+}
+
+// generate code for a "use integer" binop, these ignore "+float"
+void
+add_int_binop(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+              std::string_view opname) {
+    ArgType result = PadSv{o->op_targ};
+    if (!code.overloading) {
+        auto right = code.simplify_num(stack.pop());
+        auto left = code.simplify_num(stack.pop());
+        result = binop_int(aTHX_ o, opname, code, left, right);
+    } else {
+        auto right = code.simplify_val(stack.pop());
+        auto left = code.simplify_val(stack.pop());
+        auto out = o->op_flags & OPf_STACKED
+                       ? left
+                       : code.simplify_val(PadSv{o->op_targ});
+        result = binop_normal(aTHX_ o, opname, code, out, left, right);
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+}
+
+// generate code for a numeric comparison
+//
+// The result is always "some SV", either the result of an overload,
+// one of the boolean immortals, or for <=> possibly the target.
+void
+add_cmpop(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+          std::string_view opname, std::string_view op) {
+    // only <=> has a target
+    bool has_targ = (PL_opargs[o->op_type] & OA_TARGET) != 0;
+
+    ArgType result = PadSv{o->op_targ};
+    auto right = stack.pop();
+    auto left = stack.pop();
+    auto type = !code.overloading && code.use_float
+                    ? NumType::Nv
+                    : cmp_type(aTHX_ code, left, right);
+    if (type == NumType::Iv) {
+        // both integers, compared as perl would
+        right = code.simplify_num(right);
+        left = read_left_first(code, "IV", code.simplify_num(left), right);
+        std::ostringstream expr;
+        if (has_targ)
+            expr << "do_i_ncmp_raw(" << AsIv{left} << ", " << AsIv{right}
+                 << ")";
+        else
+            expr << AsIv{left} << " " << op << " " << AsIv{right};
+        result = declare_raw(code, has_targ ? "IV" : "bool",
+                             has_targ ? o->op_targ : 0, expr.str(),
+                             is_raw(left) && is_raw(right));
+    } else if (type == NumType::Nv) {
+        // only numbers here, so produce a raw result
+        right = code.simplify_num(right);
+        left = read_left_first(code, "NV", code.simplify_num(left), right);
+        if (has_targ) {
+            // NaN <=> anything is undef, so we need an SV
+            auto out = code.simplify_val(PadSv{o->op_targ});
+            result = code.make_local_sv();
+            code << "SV *" << result << " = " << opname << "_float(aTHX_ "
+                 << out << ", " << AsNv{left} << ", " << AsNv{right}
+                 << ");\n";
+        } else {
+            std::ostringstream expr;
+            expr << AsNv{left} << " " << op << " " << AsNv{right};
+            result = declare_raw(code, "bool", 0, expr.str(),
+                                 is_raw(left) && is_raw(right));
+        }
+    } else {
+        right = code.simplify_val(right);
+        left = code.simplify_val(left);
+        std::optional<ArgType> out;
+        if (has_targ)
+            out = code.simplify_val(PadSv{o->op_targ});
+
+        result = code.make_local_sv();
+        code << "SV *" << result << " = " << opname
+             << (code.overloading ? (code.use_float ? "_ovfloat" : "")
+                                  : "_noov")
+             << "(aTHX_ ";
+        if (out)
+            code << *out << ", ";
+        code << left << ", " << right << (code.overloading ? ", 0" : "")
+             << ");\n";
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+}
+
+// generate code for a "use integer" comparison, these ignore "+float"
+void
+add_int_cmpop(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+              std::string_view opname, std::string_view op) {
+    ArgType result = PadSv{o->op_targ};
+    if (!code.overloading) {
+        // without overloading these are simple IV comparisons
+        auto right = code.simplify_num(stack.pop());
+        auto left = read_left_first(code, "IV", code.simplify_num(stack.pop()),
+                                    right);
+        bool share = is_raw(left) && is_raw(right);
+        std::ostringstream expr;
+        if (PL_opargs[o->op_type] & OA_TARGET) {
+            // <=>
+            expr << opname << "_raw(" << AsIv{left} << ", " << AsIv{right}
+                 << ")";
+            result = declare_raw(code, "IV", o->op_targ, expr.str(), share);
+        } else {
+            expr << AsIv{left} << " " << op << " " << AsIv{right};
+            result = declare_raw(code, "bool", 0, expr.str(), share);
+        }
+    } else {
+        auto right = code.simplify_val(stack.pop());
+        auto left = code.simplify_val(stack.pop());
+        std::optional<ArgType> out;
+        if (PL_opargs[o->op_type] & OA_TARGET)
+            out = code.simplify_val(PadSv{o->op_targ});
+
+        result = code.make_local_sv();
+        code << "SV *" << result << " = " << opname << "(aTHX_ ";
+        if (out)
+            code << *out << ", ";
+        code << left << ", " << right << ", 0);\n";
+    }
 
     // only push a result if non-void
     if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
@@ -765,7 +1569,11 @@ unop_ovfloat(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
     // so just some SV
     ArgType result = code.make_local_sv();
     code << "SV *" << result << " = " << opname << "_ovfloat(aTHX_ " << out
-         << ", " << arg << ");\n";
+         << ", " << arg;
+    // only the ops that can write to a lexical need to know
+    if (PL_opargs[o->op_type] & OA_TARGLEX)
+        code << ", " << is_mutator(o);
+    code << ");\n";
 
     return result;
 }
@@ -777,7 +1585,10 @@ unop_normal(pTHX_ OP *o, std::string_view opname, CodeFragment &code,
     // so just some SV
     ArgType result = code.make_local_sv();
     code << "SV *" << result << " = " << opname << "(aTHX_ " << out << ", "
-         << arg << ");\n";
+         << arg;
+    if (PL_opargs[o->op_type] & OA_TARGLEX)
+        code << ", " << is_mutator(o);
+    code << ");\n";
 
     return result;
 }
@@ -789,73 +1600,2521 @@ unop_noov(pTHX_ std::string_view opname, CodeFragment &code, const ArgType &out,
     return out;
 }
 
-ArgType
-unop_float(pTHX_ std::string_view op, CodeFragment &code, const ArgType &out,
-           const ArgType &arg) {
-    code << "fast_sv_setnv(aTHX_ " << out << ", " << op << "SvNV(" << arg
-         << "));\n";
-    return out;
-}
-
 void
 add_unop(pTHX_ OP *o, CodeFragment &code, Stack &stack, std::string_view opname,
          std::string_view op) {
-    auto arg = code.simplify_val(stack.pop());
-    auto out = code.simplify_val(PadSv{o->op_targ});
-    ArgType result =
-        code.overloading
-            ? (code.use_float ? unop_ovfloat(aTHX_ o, opname, code, out, arg)
-                              : unop_normal(aTHX_ o, opname, code, out, arg))
-            : (code.use_float ? unop_float(aTHX_ op, code, out, arg)
-                              : unop_noov(aTHX_ opname, code, out, arg));
+    ArgType result = PadSv{o->op_targ};
+    auto arg = stack.pop();
+    // perl negates an NV without checking if it's an integer
+    if ((!code.overloading && code.use_float) ||
+        (o->op_type == OP_NEGATE && num_type(aTHX_ arg) == NumType::Nv)) {
+        arg = code.simplify_num(arg);
+        if (is_mutator(o)) {
+            auto out = code.simplify_val(PadSv{o->op_targ});
+            code << "fast_sv_setnv(aTHX_ " << out << ", " << NvUnop{op, arg}
+                 << ");\n";
+            result = out;
+        } else {
+            std::ostringstream expr;
+            expr << NvUnop{op, arg};
+            result = declare_raw(code, "NV", o->op_targ, expr.str(),
+                                 is_raw(arg));
+        }
+    } else {
+        arg = code.simplify_val(arg);
+        auto out = code.simplify_val(PadSv{o->op_targ});
+        result = code.overloading
+                     ? (code.use_float
+                            ? unop_ovfloat(aTHX_ o, opname, code, out, arg)
+                            : unop_normal(aTHX_ o, opname, code, out, arg))
+                     : unop_noov(aTHX_ opname, code, out, arg);
+    }
 
     // only push a result if non-void
     if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
         stack.push(std::move(result));
 }
 
-// given a sequence of ops, generate C a C code fragment
+// generate code for ops that always produce an NV unless overloaded,
+// like sin() or atan2(), so without overloading, even without
+// "+float", the result can be kept as a raw NV
 void
-compile_code(pTHX_ CodeFragment &code, OP *start, OP *final, OP *prev) {
-    Stack stack;
-    OP *oprev = NULL;
-    for (OP *o = start; o; o = o->op_next) {
-        logln(CCDebugFlags::TraceOps, "Compile op: {}", OpPtr(o));
-        if (DebugFlags(CCDebugFlags::DumpStack))
-            std::cerr << "Stack: " << stack << "\n";
-        logln(CCDebugFlags::TraceOps, "Op: {}", OpPtr{o});
-        switch (o->op_type) {
-        case OP_CONST:
-            stack.push(code.save_const_op(o));
-            break;
+add_nv_op(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+          std::string_view opname, bool binary) {
+    ArgType result = PadSv{o->op_targ};
+    std::optional<ArgType> right;
+    if (binary)
+        right = stack.pop();
+    auto left = stack.pop();
+    // numbers can't be overloaded
+    if (!code.overloading ||
+        (num_type(aTHX_ left) != NumType::Unknown &&
+         (!right || num_type(aTHX_ *right) != NumType::Unknown))) {
+        if (right)
+            right = code.simplify_num(*right);
+        left = code.simplify_num(left);
+        if (right)
+            left = read_left_first(code, "NV", left, *right);
+        std::ostringstream expr;
+        expr << opname << "_nv(aTHX_ " << AsNv{left};
+        if (right)
+            expr << ", " << AsNv{*right};
+        expr << ")";
+        if (is_mutator(o)) {
+            auto out = code.simplify_val(PadSv{o->op_targ});
+            code << "fast_sv_setnv(aTHX_ " << out << ", " << expr.str()
+                 << ");\n";
+            result = out;
+        } else {
+            result = declare_raw(code, "NV", o->op_targ, expr.str(),
+                                 is_raw(left) && (!right || is_raw(*right)));
+        }
+    } else {
+        if (right)
+            right = code.simplify_val(*right);
+        left = code.simplify_val(left);
+        auto out = code.simplify_val(PadSv{o->op_targ});
+        result = code.make_local_sv();
+        code << "SV *" << result << " = " << opname << "(aTHX_ " << out
+             << ", " << left;
+        if (right)
+            code << ", " << *right;
+        code << ", " << is_mutator(o) << ");\n";
+    }
 
-        case OP_PADSV:
-            stack.push(PadSv{o->op_targ});
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+}
+
+// generate code for "use integer" negation
+void
+add_int_unop(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+             std::string_view opname) {
+    ArgType result = PadSv{o->op_targ};
+    auto arg = stack.pop();
+    if (!code.overloading && is_raw(arg)) {
+        // a raw value can't be a string, so no string negation
+        std::ostringstream expr;
+        expr << opname << "_raw(aTHX_ " << AsIv{arg} << ")";
+        result = declare_raw(code, "IV", o->op_targ, expr.str(), true);
+    } else {
+        arg = code.simplify_val(arg);
+        auto out = code.simplify_val(PadSv{o->op_targ});
+        result = code.overloading
+                     ? unop_normal(aTHX_ o, opname, code, out, arg)
+                     : unop_noov(aTHX_ opname, code, out, arg);
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+}
+
+// generate code for ++ or --, which modify the operand in place
+//
+// The prefix forms leave the operand itself as the result, the
+// postfix forms leave its old value in the target.  The "use integer"
+// forms behave the same.
+bool
+add_incdec(pTHX_ OP *o, CodeFragment &code, Stack &stack,
+           std::string_view opname, bool postfix) {
+    auto sv = stack.pop();
+    if (is_raw(sv))
+        return false;
+    sv = code.simplify_val(sv);
+    ArgType result = sv;
+    if (postfix) {
+        auto targ = code.simplify_val(PadSv{o->op_targ});
+        result = code.make_local_sv();
+        code << "SV *" << result << " = " << opname << "(aTHX_ " << targ
+             << ", " << sv << ");\n";
+    } else {
+        code << opname << "(aTHX_ " << sv << ");\n";
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+    return true;
+}
+
+// a sub we call directly as C code instead of via entersub
+struct DirectCall {
+    std::string_view package;
+    std::string_view name;
+    // the number of arguments required, or 0 for any non-empty list
+    size_t arg_count;
+    // with an arg_count, a function taking and returning NVs,
+    // otherwise a function taking (pTHX_ SV *out, SV **args, count)
+    // and returning the result SV
+    std::string_view func;
+};
+
+const DirectCall direct_calls[] = {
+    {"POSIX", "floor", 1, "do_posix_floor"},
+    {"POSIX", "ceil", 1, "do_posix_ceil"},
+    {"POSIX", "fmod", 2, "do_posix_fmod"},
+    {"List::Util", "min", 0, "do_list_min"},
+    {"List::Util", "max", 0, "do_list_max"},
+    {"List::Util", "sum", 0, "do_list_sum"},
+};
+
+// if o is an entersub whose sub is known when the caller is compiled,
+// return that sub
+//
+// Redefining the sub later isn't noticed.
+CV *
+entersub_cv(pTHX_ OP *o) {
+    // only plain foo(...) calls, not &foo(...), or under the debugger
+    if (!o || o->op_type != OP_ENTERSUB || !(o->op_flags & OPf_STACKED) ||
+        (o->op_private & (OPpENTERSUB_AMPER | OPpENTERSUB_DB | OPpDEREF |
+                          OPpLVAL_INTRO)))
+        return nullptr;
+
+    // the sub is the last kid, as in ck_subr(), which has nulled
+    // the rv2cv so we can't use rv2cv_op_cv()
+    OP *cvop = cUNOPo->op_first;
+    if (!OpHAS_SIBLING(cvop))
+        cvop = cUNOPx(cvop)->op_first;
+    while (OpHAS_SIBLING(cvop))
+        cvop = OpSIBLING(cvop);
+    if (cvop->op_type != OP_NULL || cvop->op_targ != OP_RV2CV ||
+        !(cvop->op_flags & OPf_KIDS))
+        return nullptr;
+    OP *gvop = cUNOPx(cvop)->op_first;
+    if (gvop->op_type != OP_GV)
+        return nullptr;
+    SV *gvsv = reinterpret_cast<SV *>(cGVOPx_gv(gvop));
+    if (isGV(gvsv))
+        return GvCVu(reinterpret_cast<GV *>(gvsv));
+    // a sub stored directly in the stash
+    if (SvROK(gvsv) && SvTYPE(SvRV(gvsv)) == SVt_PVCV)
+        return reinterpret_cast<CV *>(SvRV(gvsv));
+    return nullptr;
+}
+
+// if o is an entersub calling one of the direct_calls XSUBs, return
+// that entry
+const DirectCall *
+find_direct_call(pTHX_ OP *o) {
+    CV *cv = entersub_cv(aTHX_ o);
+    // the results are written to the entersub's target
+    if (!cv || !CvISXSUB(cv) || !(o->op_private & OPpENTERSUB_HASTARG))
+        return nullptr;
+    GV *gv = CvGV(cv);
+    if (!gv || !GvSTASH(gv) || !HvNAME(GvSTASH(gv)))
+        return nullptr;
+
+    std::string_view package = HvNAME(GvSTASH(gv));
+    std::string_view name{GvNAME(gv), static_cast<size_t>(GvNAMELEN(gv))};
+    for (auto &call : direct_calls) {
+        if (call.package == package && call.name == name)
+            return &call;
+    }
+    return nullptr;
+}
+
+// generate code for a call found by find_direct_call()
+//
+// returns false if the call can't be made directly
+bool
+add_direct_call(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    auto call = find_direct_call(aTHX_ o);
+    if (!call || stack.marks.empty())
+        return false;
+    size_t mark = stack.marks.back();
+    stack.marks.pop_back();
+    if (mark > stack.size())
+        return false;
+    size_t count = stack.size() - mark;
+    if (call->arg_count ? count != call->arg_count : count == 0)
+        return false;
+    std::vector<ArgType> args(stack.begin() + mark, stack.end());
+    stack.stack.erase(stack.begin() + mark, stack.end());
+
+    ArgType result = PadSv{o->op_targ};
+    if (call->arg_count) {
+        // the XSUB numifies its arguments with SvNV() and returns an
+        // NV, whether or not overloading is enabled
+        bool share = true;
+        for (auto &arg : args)
+            arg = code.simplify_num(arg);
+        if (count == 2)
+            args[0] = read_left_first(code, "NV", args[0], args[1]);
+        for (auto &arg : args)
+            share = share && is_raw(arg);
+        std::ostringstream expr;
+        if (count == 1)
+            expr << NvUnop{call->func, args[0]};
+        else
+            expr << NvBinop{call->func, args[0], args[1]};
+        result = declare_raw(code, "NV", o->op_targ, expr.str(), share);
+    } else {
+        for (auto &arg : args)
+            arg = code.simplify_val(arg);
+        int list = code.local_count++;
+        code << "SV *args" << list << "[] = { ";
+        for (size_t i = 0; i < args.size(); ++i)
+            code << (i ? ", " : "") << args[i];
+        code << " };\n";
+        auto out = code.simplify_val(PadSv{o->op_targ});
+        result = code.make_local_sv();
+        code << "SV *" << result << " = " << call->func << "(aTHX_ " << out
+             << ", args" << list << ", " << count << ");\n";
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+
+    return true;
+}
+
+bool compile_op(pTHX_ OP *&o, CodeFragment &code, Stack &stack);
+
+// a sub compiled to a C function that fragments call directly instead
+// of going through entersub, skipping @_ and the pad entirely
+//
+// These are subs with only mandatory scalar parameters whose body is a
+// single expression compiled with "+float" and "no overloading", so
+// the parameters can be passed as NVs and the result returned as a
+// raw value.
+enum class LeafResult { Nv, Iv, Bool };
+
+struct LeafSub {
+    OP *root = nullptr;   // CvROOT() of the sub we compiled
+    bool ok = false;      // false if the sub can't be called directly
+    int index = 0;        // the C function is leaf<index>
+    size_t params = 0;    // the number of NV parameters
+    LeafResult result = LeafResult::Nv;
+};
+
+// subs we've tried to compile as leaf subs
+my_map<const CV *, LeafSub> leaf_subs;
+
+// the next leaf function index to generate
+int LeafIndex;
+
+// the next op in a sub body, skipping any of our ops added when the
+// body was compiled into fragments, the original ops follow them
+OP *
+next_sub_op(OP *o) {
+    while (o && o->op_type == OP_CUSTOM && o->op_ppaddr == pp_callcompiled)
+        o = o->op_next;
+    return o;
+}
+
+// an IV as a C literal
+std::string
+iv_literal(IV iv) {
+    // -IV_MIN overflows, so the literal can't be written directly
+    return iv == IV_MIN ? std::string("IV_MIN") : std::to_string(iv);
+}
+
+// a numeric constant as a raw value initialised from a C literal,
+// used in a leaf sub, which has no aux block to fetch the SV from, and
+// wherever the constant is only used as a number
+//
+// The value has no target, if it's needed as an SV it's a new mortal.
+// Each literal is declared once, later uses of the same value share it.
+std::optional<ArgType>
+const_literal(pTHX_ CodeFragment &code, OP *o) {
+    SV *sv = cSVOPx_sv(o);
+    if (!sv || SvGMAGICAL(sv) || SvROK(sv) || SvPOK(sv))
+        return std::nullopt;
+    if (SvNOK(sv)) {
+        if constexpr (!std::is_same_v<NV, double> &&
+                      !std::is_same_v<NV, long double>)
+            return std::nullopt;
+        NV nv = SvNVX(sv);
+        std::ostringstream lit;
+        if (Perl_isnan(nv))
+            lit << "NV_NAN";
+        else if (Perl_isinf(nv))
+            lit << (nv < 0 ? "-NV_INF" : "NV_INF");
+        else {
+            // exact, unlike decimal
+            lit << std::hexfloat << nv
+                << (std::is_same_v<NV, long double> ? "L" : "");
+        }
+        return declare_raw(code, "NV", 0, lit.str(), true);
+    }
+    if (SvIOK(sv) && !SvIsUV(sv))
+        return declare_raw(code, "IV", 0, iv_literal(SvIVX(sv)), true);
+    return std::nullopt;
+}
+
+// try to compile cv as a leaf sub, generating the C function and
+// saving it in @Faster::Maths::CC::leaves
+//
+// The sub's pad must be current
+bool
+compile_leaf_sub(pTHX_ CV *cv, LeafSub &leaf) {
+    OP *o = next_sub_op(CvSTART(cv));
+    if (!o || o->op_type != OP_NEXTSTATE)
+        return false;
+    const COP *cop = cCOPo;
+    o = next_sub_op(o->op_next);
+
+    // the parameters, from a signature or "my (...) = @_;"
+    std::vector<PADOFFSET> params;
+    if (o && o->op_type == OP_ARGCHECK) {
+        auto aux = reinterpret_cast<const struct op_argcheck_aux *>(
+            cUNOP_AUXo->op_aux);
+        if (aux->opt_params || aux->slurpy)
+            return false;
+        for (UV i = 0; i < aux->params; ++i) {
+            o = next_sub_op(o->op_next);
+            if (!o || o->op_type != OP_NEXTSTATE)
+                return false;
+            o = next_sub_op(o->op_next);
+            if (!o || o->op_type != OP_ARGELEM ||
+                (o->op_private & OPpARGELEM_MASK) != OPpARGELEM_SV ||
+                (o->op_flags & OPf_STACKED) ||
+                PTR2UV(cUNOP_AUXo->op_aux) != i)
+                return false;
+            params.push_back(o->op_targ);
+        }
+        o = next_sub_op(o->op_next);
+    } else if (o && o->op_type == OP_PADRANGE &&
+               (o->op_flags & OPf_SPECIAL) &&
+               (o->op_private & OPpLVAL_INTRO)) {
+        auto names = PadlistNAMES(CvPADLIST(cv));
+        int count = o->op_private & OPpPADRANGE_COUNTMASK;
+        for (int i = 0; i < count; ++i) {
+            PADNAME *pn = padnamelist_fetch(names, o->op_targ + i);
+            if (!pn || !PadnamePV(pn) || *PadnamePV(pn) != '$')
+                return false;
+            params.push_back(o->op_targ + i);
+        }
+        o = next_sub_op(o->op_next);
+        if (!o || o->op_type != OP_AASSIGN)
+            return false;
+        o = next_sub_op(o->op_next);
+    } else {
+        // no parameters, the first statement is the body
+        o = reinterpret_cast<OP *>(const_cast<COP *>(cop));
+    }
+    if (!o || o->op_type != OP_NEXTSTATE)
+        return false;
+    cop = cCOPo;
+    if (!cop_bool_config(aTHX_ cop, "Faster::Maths::CC/faster"))
+        return false;
+
+    CodeFragment code{aTHX_ cop, nullptr, true};
+    if (code.overloading || !code.use_float)
+        return false;
+    code.leaf_cv = cv;
+    // the parameters are the first locals, nv0 and so on
+    for (auto pad : params)
+        code.leaf_params.emplace(pad, code.make_raw_nv(pad).local_index);
+
+    // the body, a single expression
+    Stack stack;
+    for (o = next_sub_op(o->op_next); o && o->op_type != OP_LEAVESUB;
+         o = next_sub_op(o->op_next)) {
+        if (!compile_op(aTHX_ o, code, stack))
+            return false;
+    }
+    if (!o || stack.size() != 1 || stack.over_popped ||
+        !stack.marks.empty() || code.uses_pad || code.uses_aux)
+        return false;
+    auto result = stack.pop();
+    // returning a parameter as is would lose any string value
+    if (std::holds_alternative<RawNv>(result) &&
+        std::get<RawNv>(result).local_index < std::ssize(params))
+        return false;
+    std::string_view type;
+    if (std::holds_alternative<RawNv>(result)) {
+        leaf.result = LeafResult::Nv;
+        type = "NV";
+    } else if (std::holds_alternative<RawIv>(result)) {
+        leaf.result = LeafResult::Iv;
+        type = "IV";
+    } else if (std::holds_alternative<RawBool>(result)) {
+        leaf.result = LeafResult::Bool;
+        type = "bool";
+    } else {
+        return false;
+    }
+
+    leaf.index = LeafIndex++;
+    leaf.params = params.size();
+    std::ostringstream func;
+    func << "static inline " << type << "\nleaf" << leaf.index << "(pTHX";
+    for (size_t i = 0; i < params.size(); ++i)
+        func << (i ? ", " : "_ ") << "NV nv" << i;
+    func << ") {\n"
+         << code.prologue.str() << code.code.str() << "return " << result
+         << ";\n}\n";
+    std::string text = func.str();
+    log(CCDebugFlags::DumpCode, "{}", text);
+    av_push(get_av("Faster::Maths::CC::leaves", GV_ADD),
+            newSVpvn(text.c_str(), text.size()));
+
+    return true;
+}
+
+bool
+compile_leaf(pTHX_ CV *cv, LeafSub &leaf) {
+    if (CvISXSUB(cv) || !CvROOT(cv) || CvLVALUE(cv) || CvCLONE(cv))
+        return false;
+
+    // on threaded builds GVs and constants are found in the pad
+    ENTER;
+    SAVECOMPPAD();
+    PAD_SET_CUR_NOSAVE(CvPADLIST(cv), 1);
+    bool ok = compile_leaf_sub(aTHX_ cv, leaf);
+    LEAVE;
+    return ok;
+}
+
+// if o is an entersub calling a sub that can be compiled as a leaf
+// sub, return its details
+const LeafSub *
+find_leaf_sub(pTHX_ OP *o) {
+    CV *cv = entersub_cv(aTHX_ o);
+    if (!cv || CvISXSUB(cv))
+        return nullptr;
+    auto search = leaf_subs.find(cv);
+    if (search == leaf_subs.end() || search->second.root != CvROOT(cv)) {
+        // mark it as not a leaf first in case it calls itself
+        leaf_subs.insert_or_assign(cv, LeafSub{CvROOT(cv)});
+        LeafSub leaf{CvROOT(cv)};
+        leaf.ok = compile_leaf(aTHX_ cv, leaf);
+        if (!leaf.ok)
+            logln(CCDebugFlags::Failures, "{} isn't a leaf sub",
+                  CvGV(cv) ? GvNAME(CvGV(cv)) : "__ANON__");
+        search = leaf_subs.insert_or_assign(cv, leaf).first;
+    }
+    return search->second.ok ? &search->second : nullptr;
+}
+
+// generate code for a call found by find_leaf_sub()
+//
+// returns false if the call can't be made directly
+bool
+add_leaf_call(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    // the leaf was compiled for numeric arguments without overloading
+    const LeafSub *leaf = find_leaf_sub(aTHX_ o);
+    if (!leaf || code.overloading || stack.marks.empty())
+        return false;
+    size_t mark = stack.marks.back();
+    stack.marks.pop_back();
+    if (mark > stack.size() || stack.size() - mark != leaf->params)
+        return false;
+    std::vector<ArgType> args(stack.begin() + mark, stack.end());
+    stack.stack.erase(stack.begin() + mark, stack.end());
+
+    // a leaf sub only does arithmetic on its parameters, so a call
+    // with the same raw arguments gives the same result
+    bool share = true;
+    std::ostringstream call;
+    call << "leaf" << leaf->index << "(aTHX";
+    for (size_t i = 0; i < args.size(); ++i) {
+        args[i] = code.simplify_num(args[i]);
+        share = share && is_raw(args[i]);
+        call << (i ? ", " : "_ ") << AsNv{args[i]};
+    }
+    call << ")";
+
+    ArgType result =
+        declare_raw(code,
+                    leaf->result == LeafResult::Nv   ? "NV"
+                    : leaf->result == LeafResult::Iv ? "IV"
+                                                     : "bool",
+                    o->op_targ, call.str(), share);
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(result));
+
+    return true;
+}
+
+// given the OP_PUSHMARK or OP_PADRANGE starting a call, find the
+// entersub of a call we can make directly, nullptr if there isn't one
+OP *
+direct_call_entersub(pTHX_ OP *pushmark) {
+    int depth = 0;
+    for (OP *o = pushmark; o && o->op_type != OP_NEXTSTATE; o = o->op_next) {
+        if (o->op_type == OP_PUSHMARK || o->op_type == OP_PADRANGE) {
+            ++depth;
+        } else if (PL_opargs[o->op_type] & OA_MARK) {
+            if (--depth == 0)
+                return find_direct_call(aTHX_ o) || find_leaf_sub(aTHX_ o)
+                           ? o
+                           : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// can we compile o, an OP_SASSIGN or OP_PADSV_STORE?  Only plain
+// assignments to a lexical scalar, for "$x ||= ..." and friends see
+// is_logassign().
+bool
+is_simple_assign(const OP *o) {
+#if PERL_VERSION_GE(5, 38, 0)
+    if (o->op_type == OP_PADSV_STORE)
+        return true;
+#endif
+    if (o->op_type != OP_SASSIGN ||
+        (o->op_private & (OPpASSIGN_BACKWARDS | OPpASSIGN_CV_TO_GV)))
+        return false;
+    // the lvalue is evaluated last, just before the assignment
+    const OP *lhs = cBINOPo->op_last;
+    return lhs && lhs->op_type == OP_PADSV && lhs->op_next == o &&
+           (lhs->op_flags & OPf_MOD) && !(lhs->op_private & OPpDEREF);
+}
+
+// can we compile o, the backwards OP_SASSIGN in the other branch of
+// "$x &&= ...", "$x ||= ..." or "$x //= ..."?  The variable is left
+// on the stack by the conditional op, and must be a lexical scalar.
+bool
+is_logassign(OP *o) {
+    if (o->op_type != OP_SASSIGN ||
+        (o->op_private & (OPpASSIGN_BACKWARDS | OPpASSIGN_CV_TO_GV)) !=
+            OPpASSIGN_BACKWARDS)
+        return false;
+    OP *logop = op_parent(o);
+    if (!logop || (logop->op_type != OP_ANDASSIGN &&
+                   logop->op_type != OP_ORASSIGN &&
+                   logop->op_type != OP_DORASSIGN))
+        return false;
+    const OP *lhs = cLOGOPx(logop)->op_first;
+    return lhs->op_type == OP_PADSV && (lhs->op_flags & OPf_MOD) &&
+           !(lhs->op_private & (OPpDEREF | OPpLVAL_INTRO));
+}
+
+// can we compile o, an OP_PADSV?
+//
+// "my $x" is only handled as the target of an assignment, and of the
+// dereferences only the autovivification for $ref->[...] and
+// $ref->{...} is supported
+bool
+is_simple_padsv(const OP *o) {
+    if (o->op_private & OPpLVAL_INTRO)
+        return !(o->op_private & OPpPAD_STATE) && o->op_next &&
+               o->op_next->op_type == OP_SASSIGN &&
+               is_simple_assign(o->op_next);
+    if ((o->op_flags & OPf_MOD) && (o->op_private & OPpDEREF))
+        return (o->op_private & OPpDEREF) != OPpDEREF_SV;
+    return true;
+}
+
+// is o an op that leaves an array or hash on the stack for an element
+// fetch?  That's a plain rvalue OP_PADAV, OP_PADHV, OP_RV2AV or
+// OP_RV2HV, or the OP_GV before such an OP_RV2AV or OP_RV2HV
+bool
+is_aggregate_ref_op(const OP *o) {
+    switch (o->op_type) {
+    case OP_GV:
+        return o->op_next &&
+               (o->op_next->op_type == OP_RV2AV ||
+                o->op_next->op_type == OP_RV2HV) &&
+               is_aggregate_ref_op(o->op_next);
+
+    case OP_PADAV:
+    case OP_PADHV:
+    case OP_RV2AV:
+    case OP_RV2HV:
+        return (o->op_flags & (OPf_REF | OPf_MOD)) == OPf_REF &&
+               !(o->op_private & (OPpLVAL_INTRO | OPpMAYBE_LVSUB));
+    }
+    return false;
+}
+
+// is o, an OP_AELEM, OP_AELEMFAST, OP_AELEMFAST_LEX or OP_HELEM, an
+// element fetch we can compile?  Only rvalues that don't vivify
+// anything.
+bool
+is_rvalue_elem(const OP *o) {
+    if (o->op_flags & OPf_MOD)
+        return false;
+    // op_private is the index for OP_AELEMFAST*
+    return (o->op_type != OP_AELEM && o->op_type != OP_HELEM) ||
+           !(o->op_private & (OPpLVAL_INTRO | OPpLVAL_DEFER | OPpDEREF |
+                              OPpMAYBE_LVSUB));
+}
+
+// generate code for an array element fetch, the result is the element
+// SV itself, as the ops push
+bool
+add_aelem(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    if (!is_rvalue_elem(o))
+        return false;
+    if (o->op_type != OP_AELEM) {
+        // the array and a constant index are in the op
+        std::ostringstream av;
+        if (o->op_type == OP_AELEMFAST_LEX)
+            av << code.get_local_sv(PadSv{o->op_targ});
+        else
+            av << "GvAVn(cGVOPx_gv((OP *)aux[" << code.save_aux_op(o)
+               << "].pv))";
+        auto out = code.make_local_sv();
+        code << "SV *" << out << " = do_aelem(aTHX_ (AV *)" << av.str()
+             << ", " << static_cast<int>(static_cast<I8>(o->op_private))
+             << ");\n";
+        stack.push(out);
+        return true;
+    }
+
+    auto index = code.simplify_num(stack.pop());
+    auto av = stack.pop();
+    if (is_raw(av))
+        return false;
+    av = code.simplify_val(av);
+    auto out = code.make_local_sv();
+    code << "SV *" << out << " = ";
+    if (is_raw(index))
+        code << "do_aelem(aTHX_ (AV *)" << av << ", " << AsIv{index}
+             << ");\n";
+    else
+        code << "do_aelem_sv(aTHX_ (AV *)" << av << ", " << index << ");\n";
+    stack.push(out);
+    return true;
+}
+
+// the hash of a constant hash key, computed while generating code
+// and saved in the aux block so the lookup doesn't hash the key each
+// time, or 0 to leave it to perl
+//
+// perl makes constant keys shared hash keys, which carry their hash.
+// The hash seed is per process, so the value can't be included in
+// the generated code, which may be cached.
+U32
+const_key_hash(pTHX_ SV *keysv) {
+    if (SvIsCOW_shared_hash(keysv))
+        return SvSHARED_HASH(keysv);
+    if (!SvPOK(keysv) || SvUTF8(keysv) || SvMAGICAL(keysv))
+        return 0;
+    U32 hash;
+    PERL_HASH(hash, SvPVX(keysv), SvCUR(keysv));
+    return hash;
+}
+
+// generate code for a hash element fetch, the result is the element
+// SV itself, as pp_helem pushes
+bool
+add_helem(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    if (!is_rvalue_elem(o))
+        return false;
+    auto key = stack.pop();
+    auto hv = stack.pop();
+    if (is_raw(hv))
+        return false;
+    hv = code.simplify_val(hv);
+    U32 hash = 0;
+    if (auto c = std::get_if<OpConst>(&key))
+        hash = const_key_hash(aTHX_ cSVOPx_sv(c->op));
+    key = code.simplify_val(key);
+    auto out = code.make_local_sv();
+    code << "SV *" << out << " = do_helem(aTHX_ (HV *)" << hv << ", " << key
+         << ", ";
+    if (hash)
+        code << "(U32)aux[" << code.save_aux_uv(hash) << "].uv";
+    else
+        code << "0";
+    code << ");\n";
+    stack.push(out);
+    return true;
+}
+
+// can we compile o, an OP_MULTIDEREF?  Only rvalue fetches that
+// don't exist or delete.
+bool
+can_compile_multideref(const OP *o) {
+    if ((o->op_flags & OPf_MOD) ||
+        (o->op_private & (OPpLVAL_INTRO | OPpLVAL_DEFER | OPpMAYBE_LVSUB |
+                          OPpMULTIDEREF_EXISTS | OPpMULTIDEREF_DELETE)))
+        return false;
+    const UNOP_AUX_item *items = cUNOP_AUXx(o)->op_aux;
+    UV actions = items->uv;
+    for (;;) {
+        switch (actions & MDEREF_ACTION_MASK) {
+        case MDEREF_reload:
+            actions = (++items)->uv;
+            continue;
+
+        case MDEREF_AV_pop_rv2av_aelem:
+        case MDEREF_AV_vivify_rv2av_aelem:
+        case MDEREF_HV_pop_rv2hv_helem:
+        case MDEREF_HV_vivify_rv2hv_helem:
+            break;
+
+        case MDEREF_AV_gvsv_vivify_rv2av_aelem:
+        case MDEREF_AV_padsv_vivify_rv2av_aelem:
+        case MDEREF_AV_padav_aelem:
+        case MDEREF_AV_gvav_aelem:
+        case MDEREF_HV_gvsv_vivify_rv2hv_helem:
+        case MDEREF_HV_padsv_vivify_rv2hv_helem:
+        case MDEREF_HV_padhv_helem:
+        case MDEREF_HV_gvhv_helem:
+            ++items;
+            break;
+
+        default:
+            return false;
+        }
+        switch (actions & MDEREF_INDEX_MASK) {
+        case MDEREF_INDEX_none:
+            // the container is left for the ops that follow
+            return true;
+
+        case MDEREF_INDEX_const:
+        case MDEREF_INDEX_padsv:
+        case MDEREF_INDEX_gvsv:
+            ++items;
+            break;
+
+        default:
+            return false;
+        }
+        if (actions & MDEREF_FLAG_last)
+            return true;
+        actions >>= MDEREF_SHIFT;
+    }
+}
+
+// generate code for an OP_MULTIDEREF, a chain of element fetches perl
+// merged into a single op, adapted from pp_multideref
+//
+// The GVs and constant keys are fetched from the op's own aux items
+// at run time.
+bool
+add_multideref(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    if (!can_compile_multideref(o))
+        return false;
+    const UNOP_AUX_item *items = cUNOP_AUXo->op_aux;
+    size_t op_index = code.save_aux_op(o);
+    std::string op = std::format("(OP *)aux[{}].pv", op_index);
+    // the SV for aux item i of the multideref
+    auto item_sv = [&](size_t i) {
+        return std::format("md_item_sv(aTHX_ {}, {})", op, i);
+    };
+    auto to_string = [](const auto &val) {
+        std::ostringstream out;
+        out << val;
+        return out.str();
+    };
+    UV actions = items[0].uv;
+    size_t i = 0;
+    ArgType sv = LocalSv{0};
+    for (;;) {
+        UV action = actions & MDEREF_ACTION_MASK;
+        if (action == MDEREF_reload) {
+            actions = items[++i].uv;
+            continue;
+        }
+        bool is_hash = action >= MDEREF_HV_pop_rv2hv_helem;
+
+        // the container, or the reference to it
+        std::string ref;
+        bool deref = true;
+        switch (action) {
+        case MDEREF_AV_pop_rv2av_aelem:
+        case MDEREF_HV_pop_rv2hv_helem: {
+            auto top = stack.pop();
+            if (is_raw(top))
+                return false;
+            ref = to_string(code.simplify_val(top));
+        } break;
+
+        case MDEREF_AV_gvsv_vivify_rv2av_aelem:
+        case MDEREF_HV_gvsv_vivify_rv2hv_helem:
+            ref = std::format("GvSVn((GV *){})", item_sv(++i));
+            break;
+
+        case MDEREF_AV_padsv_vivify_rv2av_aelem:
+        case MDEREF_HV_padsv_vivify_rv2hv_helem:
+            ref = to_string(code.get_local_sv(PadSv{items[++i].pad_offset}));
+            break;
+
+        case MDEREF_AV_vivify_rv2av_aelem:
+        case MDEREF_HV_vivify_rv2hv_helem:
+            // the element from the previous action
+            ref = to_string(sv);
+            break;
+
+        case MDEREF_AV_padav_aelem:
+        case MDEREF_HV_padhv_helem:
+            ref = to_string(code.get_local_sv(PadSv{items[++i].pad_offset}));
+            deref = false;
+            break;
+
+        case MDEREF_AV_gvav_aelem:
+            ref = std::format("(SV *)GvAVn((GV *){})", item_sv(++i));
+            deref = false;
             break;
 
-        case OP_ADD:
-            add_binop(aTHX_ o, code, stack, "do_add", "+");
-            break;
+        case MDEREF_HV_gvhv_helem:
+            ref = std::format("(SV *)GvHVn((GV *){})", item_sv(++i));
+            deref = false;
+            break;
+
+        default:
+            return false;
+        }
+        if (deref) {
+            const char *type = is_hash ? "hv" : "av";
+            if (action != MDEREF_AV_pop_rv2av_aelem &&
+                action != MDEREF_HV_pop_rv2hv_helem)
+                ref = std::format("do_vivify_{}(aTHX_ {})", type, ref);
+            ref = std::format("(SV *)do_md_rv2{}(aTHX_ {}, {})", type, ref,
+                              op);
+        }
+        auto container = code.make_local_sv();
+        code << "SV *" << container << " = " << ref << ";\n";
+
+        // the index or key
+        std::string index;
+        U32 hash = 0;
+        switch (actions & MDEREF_INDEX_MASK) {
+        case MDEREF_INDEX_none:
+            // an aelem or helem follows, with the index computed by
+            // other ops
+            stack.push(container);
+            return true;
+
+        case MDEREF_INDEX_const:
+            ++i;
+            if (is_hash) {
+#ifdef USE_ITHREADS
+                SV *keysv = PAD_SVl(items[i].pad_offset);
+#else
+                SV *keysv = items[i].sv;
+#endif
+                hash = const_key_hash(aTHX_ keysv);
+                index = item_sv(i);
+            }
+            else {
+                index = iv_literal(items[i].iv);
+            }
+            break;
+
+        case MDEREF_INDEX_padsv:
+            index = to_string(code.get_local_sv(PadSv{items[++i].pad_offset}));
+            break;
+
+        case MDEREF_INDEX_gvsv:
+            index = std::format("GvSVn((GV *){})", item_sv(++i));
+            break;
+
+        default:
+            return false;
+        }
+        if (!is_hash && (actions & MDEREF_INDEX_MASK) != MDEREF_INDEX_const)
+            index = std::format("do_md_index(aTHX_ {})", index);
+
+        bool last = actions & MDEREF_FLAG_last;
+        sv = code.make_local_sv();
+        code << "SV *" << sv << " = ";
+        if (is_hash) {
+            code << (last ? "do_helem" : "do_md_helem_lval") << "(aTHX_ (HV *)"
+                 << container << ", " << index << ", ";
+            if (hash)
+                code << "(U32)aux[" << code.save_aux_uv(hash) << "].uv";
+            else
+                code << "0";
+            code << ");\n";
+        }
+        else {
+            code << (last ? "do_aelem" : "do_md_aelem_lval") << "(aTHX_ (AV *)"
+                 << container << ", " << index << ");\n";
+        }
+        if (last)
+            break;
+        actions >>= MDEREF_SHIFT;
+    }
+    stack.push(std::move(sv));
+    return true;
+}
+
+// generate code to store val in var, a pad scalar
+void
+add_store(CodeFragment &code, const LocalSv &var, const ArgType &val) {
+    // raw values are stored directly instead of through their target
+    if (auto nv = std::get_if<RawNv>(&val))
+        code << "fast_sv_setnv(aTHX_ " << var << ", " << *nv << ");\n";
+    else if (auto iv = std::get_if<RawIv>(&val))
+        code << "fast_sv_setiv(aTHX_ " << var << ", " << *iv << ");\n";
+    else {
+        // boxing a raw bool generates code, so before the call
+        auto sv = code.simplify_val(val);
+        code << "do_sassign(aTHX_ " << var << ", " << sv << ");\n";
+    }
+}
+
+// generate code to assign val to the pad scalar targ, as pp_sassign
+// or pp_padsv_store would, the result is the variable itself
+bool
+add_assign(pTHX_ OP *o, CodeFragment &code, Stack &stack, PADOFFSET targ,
+           const ArgType &val) {
+    auto var = code.get_local_sv(PadSv{targ});
+    add_store(code, var, val);
+    if ((o->op_flags & OPf_WANT) != OPf_WANT_VOID)
+        stack.push(var);
+    return true;
+}
+
+// if o, an OP_PUSHMARK or OP_PADRANGE, starts one of the lists of an
+// OP_AASSIGN return that op, *lhs is set if it's the variables
+OP *
+list_assign_op(OP *o, bool *lhs = nullptr) {
+    OP *list = op_parent(o);
+    if (!list || !(list->op_type == OP_LIST ||
+                   (list->op_type == OP_NULL && list->op_targ == OP_LIST)))
+        return nullptr;
+    OP *aassign = op_parent(list);
+    if (!aassign || aassign->op_type != OP_AASSIGN)
+        return nullptr;
+    if (cLISTOPx(list)->op_first != o)
+        return nullptr;
+    if (lhs)
+        *lhs = cBINOPx(aassign)->op_last == list;
+    return aassign;
+}
+
+// generate code for a list assignment of values to pad scalars in
+// void context, such as "($x, $y) = ($y, $x + $y)"
+//
+// Each value is fetched before any variable is stored.  If perl
+// found the variables might also be among the values, any value
+// after the first that isn't a temporary is copied first, as
+// pp_aassign does.
+bool
+add_list_assign(pTHX_ OP *o, CodeFragment &code, Stack &stack) {
+    if ((o->op_flags & OPf_WANT) != OPf_WANT_VOID || stack.marks.size() < 2)
+        return false;
+    size_t lmark = stack.marks.back();
+    size_t rmark = stack.marks[stack.marks.size() - 2];
+    stack.marks.resize(stack.marks.size() - 2);
+    if (lmark > stack.size() || rmark > lmark)
+        return false;
+    size_t count = stack.size() - lmark;
+    // perl sets extra variables to undef, leave that to it
+    if (count == 0 || lmark - rmark != count)
+        return false;
+    std::vector<ArgType> vals(stack.begin() + rmark, stack.begin() + lmark);
+    std::vector<LocalSv> vars;
+    for (auto it = stack.begin() + lmark; it != stack.end(); ++it) {
+        auto var = std::get_if<PadSv>(&*it);
+        if (!var)
+            return false;
+        vars.push_back(code.get_local_sv(*var));
+    }
+    stack.stack.erase(stack.begin() + rmark, stack.end());
+
+    if (o->op_private & (OPpASSIGN_COMMON_AGG | OPpASSIGN_COMMON_RC1 |
+                         OPpASSIGN_COMMON_SCALAR)) {
+        for (size_t i = 1; i < count; ++i) {
+            if (is_raw(vals[i]) || std::holds_alternative<OpConst>(vals[i]))
+                continue;
+            auto val = code.simplify_val(vals[i]);
+            auto copy = code.make_local_sv();
+            code << "SV *" << copy << " = do_aassign_copy(aTHX_ " << val
+                 << ");\n";
+            vals[i] = copy;
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+        add_store(code, vars[i], vals[i]);
+    return true;
+}
+
+// "my $x", the variable is cleared when the enclosing scope is left,
+// as pp_padsv does
+void
+add_clearsv(CodeFragment &code, PADOFFSET targ) {
+    code.uses_pad = true;
+    code << "SAVECLEARSV(PAD_SVl(" << targ << "));\n";
+}
+
+// is o a conditional op we compile, see add_logop()?
+inline bool
+is_compiled_logop(const OP *o) {
+    switch (o->op_type) {
+    case OP_AND:
+    case OP_OR:
+    case OP_DOR:
+    case OP_COND_EXPR:
+    case OP_ANDASSIGN:
+    case OP_ORASSIGN:
+    case OP_DORASSIGN:
+        return true;
+    }
+    return false;
+}
+
+// the last op of the other branch of o, a conditional op, its op_next
+// is where the paths through o meet again.
+//
+// o's own op_next isn't used, for "&&" and friends perl may point it
+// past a following op of the same type, which would repeat the test.
+//
+// returns nullptr if the paths don't meet
+OP *
+logop_last(OP *o) {
+    OP *last = cLOGOPo->op_other;
+    for (;;) {
+        if (is_compiled_logop(last)) {
+            if (!(last = logop_last(last)))
+                return nullptr;
+        } else if (last->op_type == OP_NEXTSTATE ||
+                   last->op_type == OP_DBSTATE ||
+                   last->op_type == OP_UNSTACK ||
+                   last->op_type == OP_ENTERLOOP ||
+                   last->op_type == OP_ENTERITER) {
+            // statements, such as the body of a while loop, whose
+            // op_next chain may cycle back, we only compile expressions
+            return nullptr;
+        }
+        if (!last->op_next)
+            return nullptr;
+        if (!op_within(last->op_next, o))
+            return last;
+        last = last->op_next;
+    }
+}
+
+// compile the ops from start until join, a branch of a conditional,
+// into text.  The branch must leave the stack at base values, plus
+// its result if want is set, which is popped into val.
+bool
+compile_branch(pTHX_ OP *start, OP *join, CodeFragment &code, Stack &stack,
+               size_t base, bool want, std::string &text,
+               std::optional<ArgType> &val) {
+    auto over_popped = stack.over_popped;
+    auto marks = stack.marks.size();
+    bool ok = true;
+    text = code.capture([&] {
+        for (OP *o = start; ok && o != join; o = o->op_next)
+            ok = o && compile_op(aTHX_ o, code, stack);
+    });
+    if (!ok || stack.over_popped != over_popped ||
+        stack.marks.size() != marks || stack.size() < base ||
+        (want && stack.size() != base + 1))
+        return false;
+    if (want)
+        val = stack.pop();
+    else
+        stack.stack.erase(stack.begin() + base, stack.end());
+    return true;
+}
+
+// is arg a leaf sub parameter, which perl would return as the SV?
+inline bool
+is_leaf_param(const CodeFragment &code, const ArgType &arg) {
+    auto nv = std::get_if<RawNv>(&arg);
+    return nv && code.leaf_cv && nv->local_index < std::ssize(code.leaf_params);
+}
+
+// merge the results of the two paths through a conditional into a
+// single C variable, adding the code to set it to each path's code.
+//
+// The variable is raw if both results are raw the same way, otherwise
+// an SV.
+ArgType
+merge_results(CodeFragment &code, const ArgType &a, std::string &a_code,
+              const ArgType &b, std::string &b_code) {
+    if (a.index() == b.index() && is_raw(a) && !is_leaf_param(code, a) &&
+        !is_leaf_param(code, b)) {
+        ArgType result = std::visit(
+            overloaded{
+                [&](const RawNv &nv) -> ArgType {
+                    return code.make_raw_nv(nv.targ);
+                },
+                [&](const RawIv &iv) -> ArgType {
+                    return code.make_raw_iv(iv.targ);
+                },
+                [&](const auto &) -> ArgType { return code.make_raw_bool(); },
+            },
+            a);
+        code.declare(std::holds_alternative<RawNv>(a)   ? "NV "
+                     : std::holds_alternative<RawIv>(a) ? "IV "
+                                                        : "bool ",
+                     result, ";\n");
+        a_code += code.capture([&] { code << result << " = " << a << ";\n"; });
+        b_code += code.capture([&] { code << result << " = " << b << ";\n"; });
+        return result;
+    }
+
+    auto result = code.make_local_sv();
+    code.declare("SV *", result, ";\n");
+    // boxing raw values generates code, so it belongs to the path
+    auto set = [&](const ArgType &val) {
+        auto sv = code.simplify_val(val);
+        code << result << " = " << sv << ";\n";
+    };
+    a_code += code.capture([&] { set(a); });
+    b_code += code.capture([&] { set(b); });
+    return result;
+}
+
+// generate C control flow for o, a conditional op: "&&", "||", "//",
+// their assignment forms, or "?:".  The branch perl would jump to
+// with op_other is compiled within an "if", and any result is merged
+// into a single C variable.
+//
+// o is updated to the last op of the conditional, see logop_last()
+bool
+add_logop(pTHX_ OP *&o, CodeFragment &code, Stack &stack) {
+    OP *last = logop_last(o);
+    if (!last)
+        return false;
+    OP *join = last->op_next;
+    bool assign = o->op_type == OP_ANDASSIGN || o->op_type == OP_ORASSIGN ||
+                  o->op_type == OP_DORASSIGN;
+    bool want = (o->op_flags & OPf_WANT) != OPf_WANT_VOID;
+
+    // the value tested, the assignment forms leave their variable on
+    // the stack for the backwards OP_SASSIGN in the other branch
+    auto cond = stack.pop();
+    if (assign) {
+        if (!std::holds_alternative<PadSv>(cond))
+            return false;
+        stack.push(ArgType{cond});
+    }
+    size_t base = stack.size() - assign;
+    auto test = code.simplify_num(cond);
+
+    std::string then_code, else_code;
+    std::optional<ArgType> then_val, else_val;
+    if (!compile_branch(aTHX_ cLOGOPo->op_other, join, code, stack, base,
+                        want, then_code, then_val))
+        return false;
+    if (o->op_type == OP_COND_EXPR &&
+        !compile_branch(aTHX_ o->op_next, join, code, stack, base, want,
+                        else_code, else_val))
+        return false;
+
+    if (assign) {
+        // the assignment's result is the variable we tested
+        if (want)
+            stack.push(std::move(*then_val));
+    } else if (want) {
+        if (o->op_type != OP_COND_EXPR)
+            else_val = test;
+        stack.push(merge_results(code, *then_val, then_code, *else_val,
+                                 else_code));
+    }
+
+    code << "if (";
+    switch (o->op_type) {
+    case OP_OR:
+    case OP_ORASSIGN:
+        code << "!" << AsBool{test};
+        break;
+    case OP_DOR:
+    case OP_DORASSIGN:
+        // a raw value is always defined
+        if (is_raw(test))
+            code << "0";
+        else
+            code << "!do_defined(aTHX_ " << test << ")";
+        break;
+    default:
+        code << AsBool{test};
+        break;
+    }
+    code << ") {\n" << then_code << "}\n";
+    if (!else_code.empty())
+        code << "else {\n" << else_code << "}\n";
+
+    o = last;
+    return true;
+}
+
+// generate code for a single expression op
+//
+// For a conditional op both branches are compiled and o is updated to
+// the last op of the conditional, see logop_last().
+//
+// returns false if the op isn't supported
+bool
+compile_op(pTHX_ OP *&o, CodeFragment &code, Stack &stack) {
+    logln(CCDebugFlags::TraceOps, "Compile op: {}", OpPtr(o));
+    if (DebugFlags(CCDebugFlags::DumpStack))
+        std::cerr << "Stack: " << stack << "\n";
+    switch (o->op_type) {
+    case OP_CONST:
+        if (code.leaf_cv) {
+            if (auto lit = const_literal(aTHX_ code, o)) {
+                stack.push(std::move(*lit));
+                break;
+            }
+        }
+        stack.push(code.save_const_op(o));
+        break;
+
+    case OP_PADSV:
+        if (!is_simple_padsv(o))
+            return false;
+        if ((o->op_flags & OPf_MOD) && (o->op_private & OPpDEREF)) {
+            auto ref = code.make_local_sv();
+            code << "SV *" << ref << " = "
+                 << ((o->op_private & OPpDEREF) == OPpDEREF_AV
+                         ? "do_vivify_av"
+                         : "do_vivify_hv")
+                 << "(aTHX_ " << code.get_local_sv(PadSv{o->op_targ})
+                 << ");\n";
+            stack.push(ref);
+            break;
+        }
+        if (o->op_private & OPpLVAL_INTRO)
+            add_clearsv(code, o->op_targ);
+        stack.push(code.pad_value(o->op_targ));
+        break;
+
+    case OP_SASSIGN: {
+        // a backwards assignment has the value on top
+        bool backwards = o->op_private & OPpASSIGN_BACKWARDS;
+        if (!(backwards ? is_logassign(o) : is_simple_assign(o)))
+            return false;
+        auto top = stack.pop();
+        auto below = stack.pop();
+        auto &lhs = backwards ? below : top;
+        auto &val = backwards ? top : below;
+        auto var = std::get_if<PadSv>(&lhs);
+        if (!var)
+            return false;
+        return add_assign(aTHX_ o, code, stack, var->index, val);
+    }
+
+#if PERL_VERSION_GE(5, 38, 0)
+    case OP_PADSV_STORE:
+        if ((o->op_private & (OPpLVAL_INTRO | OPpPAD_STATE)) == OPpLVAL_INTRO)
+            add_clearsv(code, o->op_targ);
+        return add_assign(aTHX_ o, code, stack, o->op_targ, stack.pop());
+#endif
+
+    case OP_PADAV:
+    case OP_PADHV:
+        if (!is_aggregate_ref_op(o))
+            return false;
+        // the AV or HV itself
+        stack.push(code.get_local_sv(PadSv{o->op_targ}));
+        break;
+
+    case OP_RV2AV:
+    case OP_RV2HV: {
+        if (!is_aggregate_ref_op(o))
+            return false;
+        auto sv = stack.pop();
+        if (is_raw(sv))
+            return false;
+        sv = code.simplify_val(sv);
+        auto xv = code.make_local_sv();
+        code << "SV *" << xv << " = (SV *)"
+             << (o->op_type == OP_RV2AV ? "do_rv2av" : "do_rv2hv") << "(aTHX_ "
+             << sv << ", (OP *)aux[" << code.save_aux_op(o) << "].pv);\n";
+        stack.push(xv);
+    } break;
+
+    case OP_AELEMFAST:
+    case OP_AELEMFAST_LEX:
+    case OP_AELEM:
+        return add_aelem(aTHX_ o, code, stack);
+
+    case OP_HELEM:
+        return add_helem(aTHX_ o, code, stack);
+
+    case OP_MULTIDEREF:
+        return add_multideref(aTHX_ o, code, stack);
+
+    case OP_ADD:
+        add_binop(aTHX_ o, code, stack, "do_add", "+");
+        break;
+
+    case OP_SUBTRACT:
+        add_binop(aTHX_ o, code, stack, "do_subtract", "-");
+        break;
+
+    case OP_MULTIPLY:
+        add_binop(aTHX_ o, code, stack, "do_multiply", "*");
+        break;
+
+    case OP_DIVIDE:
+        add_binop(aTHX_ o, code, stack, "do_divide", "/");
+        break;
+
+    case OP_MODULO:
+        add_binop(aTHX_ o, code, stack, "do_modulo", "do_modulo_nv");
+        break;
+
+    case OP_POW:
+        add_binop(aTHX_ o, code, stack, "do_pow", "do_pow_nv");
+        break;
+
+    case OP_NEGATE:
+        add_unop(aTHX_ o, code, stack, "do_negate", "-");
+        break;
+
+    case OP_ABS:
+        add_unop(aTHX_ o, code, stack, "do_abs", "do_abs_nv");
+        break;
+
+    case OP_INT:
+        add_unop(aTHX_ o, code, stack, "do_int", "do_int_nv");
+        break;
+
+    case OP_SIN:
+        add_nv_op(aTHX_ o, code, stack, "do_sin", false);
+        break;
+
+    case OP_COS:
+        add_nv_op(aTHX_ o, code, stack, "do_cos", false);
+        break;
+
+    case OP_EXP:
+        add_nv_op(aTHX_ o, code, stack, "do_exp", false);
+        break;
+
+    case OP_LOG:
+        add_nv_op(aTHX_ o, code, stack, "do_log", false);
+        break;
+
+    case OP_SQRT:
+        add_nv_op(aTHX_ o, code, stack, "do_sqrt", false);
+        break;
+
+    case OP_ATAN2:
+        add_nv_op(aTHX_ o, code, stack, "do_atan2", true);
+        break;
+
+    case OP_I_ADD:
+        add_int_binop(aTHX_ o, code, stack, "do_i_add");
+        break;
+
+    case OP_I_SUBTRACT:
+        add_int_binop(aTHX_ o, code, stack, "do_i_subtract");
+        break;
+
+    case OP_I_MULTIPLY:
+        add_int_binop(aTHX_ o, code, stack, "do_i_multiply");
+        break;
+
+    case OP_I_DIVIDE:
+        add_int_binop(aTHX_ o, code, stack, "do_i_divide");
+        break;
+
+    case OP_I_MODULO:
+        add_int_binop(aTHX_ o, code, stack, "do_i_modulo");
+        break;
+
+    case OP_I_NEGATE:
+        add_int_unop(aTHX_ o, code, stack, "do_i_negate");
+        break;
+
+    case OP_PREINC:
+    case OP_I_PREINC:
+        return add_incdec(aTHX_ o, code, stack, "do_preinc", false);
+
+    case OP_PREDEC:
+    case OP_I_PREDEC:
+        return add_incdec(aTHX_ o, code, stack, "do_predec", false);
+
+    case OP_POSTINC:
+    case OP_I_POSTINC:
+        return add_incdec(aTHX_ o, code, stack, "do_postinc", true);
+
+    case OP_POSTDEC:
+    case OP_I_POSTDEC:
+        return add_incdec(aTHX_ o, code, stack, "do_postdec", true);
+
+    case OP_LT:
+        add_cmpop(aTHX_ o, code, stack, "do_lt", "<");
+        break;
+
+    case OP_GT:
+        add_cmpop(aTHX_ o, code, stack, "do_gt", ">");
+        break;
+
+    case OP_LE:
+        add_cmpop(aTHX_ o, code, stack, "do_le", "<=");
+        break;
+
+    case OP_GE:
+        add_cmpop(aTHX_ o, code, stack, "do_ge", ">=");
+        break;
+
+    case OP_EQ:
+        add_cmpop(aTHX_ o, code, stack, "do_eq", "==");
+        break;
+
+    case OP_NE:
+        add_cmpop(aTHX_ o, code, stack, "do_ne", "!=");
+        break;
+
+    case OP_NCMP:
+        add_cmpop(aTHX_ o, code, stack, "do_ncmp", "<=>");
+        break;
+
+    case OP_I_LT:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_lt", "<");
+        break;
+
+    case OP_I_GT:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_gt", ">");
+        break;
+
+    case OP_I_LE:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_le", "<=");
+        break;
+
+    case OP_I_GE:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_ge", ">=");
+        break;
+
+    case OP_I_EQ:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_eq", "==");
+        break;
+
+    case OP_I_NE:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_ne", "!=");
+        break;
+
+    case OP_I_NCMP:
+        add_int_cmpop(aTHX_ o, code, stack, "do_i_ncmp", "<=>");
+        break;
+
+    case OP_PUSHMARK:
+        // the arguments for a call follow
+        stack.marks.push_back(stack.size());
+        break;
+
+    case OP_PADRANGE: {
+        // a pushmark followed by a run of pad variables, but only
+        // handle scalars, and "my (...)" only as the variables of a
+        // list assignment
+        bool lhs = false;
+        if ((o->op_private & OPpLVAL_INTRO) &&
+            (!list_assign_op(o, &lhs) || !lhs))
+            return false;
+        int count = o->op_private & OPpPADRANGE_COUNTMASK;
+        OP *kid = OpSIBLING(o);
+        for (int i = 0; i < count; ++i, kid = OpSIBLING(kid)) {
+            if (!kid || kid->op_type != OP_PADSV ||
+                kid->op_targ != o->op_targ + i)
+                return false;
+        }
+        stack.marks.push_back(stack.size());
+        for (int i = 0; i < count; ++i) {
+            if (o->op_private & OPpLVAL_INTRO)
+                add_clearsv(code, o->op_targ + i);
+            stack.push(code.pad_value(o->op_targ + i));
+        }
+    } break;
+
+    case OP_AASSIGN:
+        return add_list_assign(aTHX_ o, code, stack);
+
+    case OP_GV:
+        if (is_aggregate_ref_op(o)) {
+            // the glob for @name or %name, the OP_RV2AV or OP_RV2HV
+            // fetches the array or hash
+            auto gv = code.make_local_sv();
+            code << "SV *" << gv << " = (SV *)cGVOPx_gv((OP *)aux["
+                 << code.save_aux_op(o) << "].pv);\n";
+            stack.push(gv);
+            break;
+        }
+        // entersub would take the sub from the stack, but a direct
+        // call doesn't need it
+        if (!find_direct_call(aTHX_ o->op_next) &&
+            !find_leaf_sub(aTHX_ o->op_next))
+            return false;
+        break;
+
+    case OP_ENTERSUB:
+        if (find_direct_call(aTHX_ o))
+            return add_direct_call(aTHX_ o, code, stack);
+        return add_leaf_call(aTHX_ o, code, stack);
+
+    case OP_AND:
+    case OP_OR:
+    case OP_DOR:
+    case OP_COND_EXPR:
+    case OP_ANDASSIGN:
+    case OP_ORASSIGN:
+    case OP_DORASSIGN:
+        return add_logop(aTHX_ o, code, stack);
+
+    case OP_UNDEF: {
+        // only a plain undef value, not "undef $x"
+        if ((o->op_flags & OPf_KIDS) || o->op_private)
+            return false;
+        auto sv = code.make_local_sv();
+        code << "SV *" << sv << " = &PL_sv_undef;\n";
+        stack.push(sv);
+    } break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+// can the ops from first to last, such as a direct call from its
+// pushmark to its entersub, all be compiled?
+bool
+can_compile_ops(pTHX_ const COP *cop, OP *first, OP *last) {
+    CodeFragment code{aTHX_ cop, nullptr, true};
+    Stack stack;
+    for (OP *o = first; o; o = o->op_next) {
+        if (!compile_op(aTHX_ o, code, stack))
+            return false;
+        if (o == last)
+            return true;
+    }
+    return false;
+}
+
+// track the calls we make directly for rpeep_for_callcompiled(),
+// open_calls is the number of calls we're within
+//
+// returns true if o, an OP_PUSHMARK, OP_PADRANGE, OP_GV or OP_ENTERSUB,
+// can be part of the fragment
+bool
+accept_call_op(pTHX_ OP *o, const COP *cop, int &open_calls) {
+    switch (o->op_type) {
+    case OP_PUSHMARK:
+    case OP_PADRANGE: {
+        // check the whole call up front, so the fragment can't end
+        // part way through it
+        OP *entersub = direct_call_entersub(aTHX_ o);
+        if (!entersub || !can_compile_ops(aTHX_ cop, o, entersub))
+            return false;
+        ++open_calls;
+        return true;
+    }
+
+    case OP_GV:
+        return open_calls > 0;
+
+    case OP_ENTERSUB:
+        if (open_calls == 0)
+            return false;
+        --open_calls;
+        return true;
+    }
+    return false;
+}
+
+// track the list assignments we compile for rpeep_for_callcompiled(),
+// open_assigns is the number we're within
+//
+// returns true if o, an OP_PUSHMARK, OP_PADRANGE or OP_AASSIGN, can be
+// part of the fragment
+bool
+accept_list_assign_op(pTHX_ OP *o, const COP *cop, int &open_assigns) {
+    if (o->op_type == OP_AASSIGN) {
+        if (open_assigns == 0)
+            return false;
+        --open_assigns;
+        return true;
+    }
+    bool lhs = false;
+    OP *aassign = list_assign_op(o, &lhs);
+    if (!aassign)
+        return false;
+    if (lhs)
+        return open_assigns > 0;
+    // check the whole assignment from the start of the values, so
+    // the fragment can't end part way through it
+    if (!can_compile_ops(aTHX_ cop, o, aassign))
+        return false;
+    ++open_assigns;
+    return true;
+}
+
+// can o, a conditional op, be compiled with both its branches as
+// part of the fragment starting at first?
+//
+// returns the last op of the conditional, see logop_last()
+OP *
+accept_logop(pTHX_ OP *o, OP *first, const COP *cop) {
+    OP *last = logop_last(o);
+    if (!last || !can_compile_ops(aTHX_ cop, first, last))
+        return nullptr;
+    return last;
+}
+
+// the IV specialisation of a fragment
+//
+// Most arithmetic is done on plain integers, which the generic code
+// handles through do_add() and friends, checking for magic,
+// overloading and strings at each op, and storing each result in the
+// op's target.  For a fragment made only of arithmetic, comparisons
+// and assignments to lexicals a second version is generated working
+// on C IVs, run when a check on entry finds every value it reads is a
+// plain IV, see guard_iv_read(), and every variable it stores to is
+// free of magic, see guard_iv_store().
+//
+// Where perl would produce an NV, as when an addition overflows, the
+// specialisation jumps to the generic code, which starts over.  It
+// can only do that before anything it did is visible, such as a
+// store to a variable, so fragments that would need to are left
+// generic.
+//
+// The ops are first translated to a small SSA form, one SpecInsn for
+// each step, each defining a C local that never changes.  The passes
+// in spec_passes then improve that, and the C is generated from what
+// is left, see spec_emit().
+//
+// So far only the specialisation is built this way.  The generic
+// code is still generated as the ops are compiled, and its sharing of
+// repeated arithmetic, see declare_raw(), its choice of raw C values,
+// see certain_nv_binop() and cmp_type(), and its literal constants,
+// see const_literal(), are made op by op rather than as passes.
+
+// the operations of the IV specialisation
+enum class SpecOp {
+    Load,      // the IV of the SV named sv, read with SvIVX()
+    Const,     // the IV value
+    BoolConst, // the bool value
+    Add,       // these go to the generic code where perl's result
+    Subtract,  // wouldn't be an IV
+    Multiply,
+    Negate,
+    Abs,
+    IAdd, // the "use integer" ops, which wrap
+    ISubtract,
+    IMultiply,
+    IDivide, // these croak for a zero right operand
+    IModulo,
+    INegate,
+    Ncmp,
+    Lt, // these produce a bool
+    Gt,
+    Le,
+    Ge,
+    Eq,
+    Ne,
+    Store,   // store the IV args[0] in the variable named sv
+    ClearSv, // SAVECLEARSV() for the pad entry targ
+};
+
+// names for the PERL_FMC_DEBUG=i dump, in SpecOp order
+const char *const spec_op_names[] = {
+    "load",       "const",      "boolconst", "add",      "subtract",
+    "multiply",   "negate",     "abs",       "i_add",    "i_subtract",
+    "i_multiply", "i_divide",   "i_modulo",  "i_negate", "ncmp",
+    "lt",         "gt",         "le",        "ge",       "eq",
+    "ne",         "store",      "clearsv",
+};
+
+// a step of the IV specialisation
+struct SpecInsn {
+    SpecOp op;
+    int result = -1;       // the local index defined, if any
+    std::vector<int> args; // the local indexes used
+    IV value = 0;          // for Const and BoolConst
+    std::string sv;        // for Load and Store
+    bool stack = false;    // sv is a stack entry
+    PADOFFSET targ = 0;    // for ClearSv
+    bool dead = false;     // removed by a pass
+
+    // is the result a bool rather than an IV?
+    bool
+    is_bool() const {
+        return op == SpecOp::BoolConst ||
+               (op >= SpecOp::Lt && op <= SpecOp::Ne);
+    }
+    // can it go to the generic code?
+    bool
+    checked() const {
+        return op >= SpecOp::Add && op <= SpecOp::Abs;
+    }
+    // does it change anything perl code can see?
+    bool
+    effects() const {
+        return op == SpecOp::Store || op == SpecOp::ClearSv;
+    }
+    // must it run, even if the result isn't used?
+    bool
+    needed() const {
+        return effects() || op == SpecOp::IDivide || op == SpecOp::IModulo;
+    }
+};
+
+std::ostream &
+operator<<(std::ostream &out, const SpecInsn &insn) {
+    if (insn.result >= 0)
+        out << (insn.is_bool() ? "b" : "iv") << insn.result << " = ";
+    out << spec_op_names[static_cast<int>(insn.op)];
+    if (insn.op == SpecOp::Const || insn.op == SpecOp::BoolConst)
+        out << " " << insn.value;
+    else if (insn.op == SpecOp::ClearSv)
+        out << " " << insn.targ;
+    if (!insn.sv.empty())
+        out << " " << insn.sv;
+    for (size_t i = 0; i < insn.args.size(); ++i)
+        out << (i || !insn.sv.empty() ? ", iv" : " iv") << insn.args[i];
+    return out;
+}
+
+struct SpecIv {
+    // add a check to make on entry, returns false if it's a repeat
+    bool
+    guard(std::string check) {
+        if (std::find(guards.begin(), guards.end(), check) != guards.end())
+            return false;
+        guards.push_back(std::move(check));
+        return true;
+    }
+    // add insn, which defines a new local, returning the local index
+    int
+    add(CodeFragment &code, SpecInsn insn) {
+        insn.result = insn.is_bool() ? code.make_raw_bool().local_index
+                                     : code.make_raw_iv(0).local_index;
+        insns.push_back(std::move(insn));
+        return insns.back().result;
+    }
+    // use the local to instead of from, in the steps and in the
+    // results left on stack
+    void
+    replace(int from, int to, Stack &stack) {
+        for (auto &insn : insns)
+            std::replace(insn.args.begin(), insn.args.end(), from, to);
+        for (auto &item : stack) {
+            if (auto iv = std::get_if<RawIv>(&item)) {
+                if (iv->local_index == from)
+                    iv->local_index = to;
+            } else if (auto b = std::get_if<RawBool>(&item)) {
+                if (b->local_index == from)
+                    b->local_index = to;
+            }
+        }
+    }
+    std::vector<std::string> guards;
+    // the values read from SVs, for profiling
+    std::vector<ArgType> inputs;
+    // the steps, in order
+    std::vector<SpecInsn> insns;
+    // local indexes of the variables stored to, which hold IVs from
+    // then on
+    std::vector<int> stored;
+    // the code can jump to the generic code
+    bool deopts = false;
+};
+
+// the local holding the value of arg as a C IV for the IV
+// specialisation, adding a step reading it from the SV if needed
+//
+// returns nullopt if the value might not be an IV
+std::optional<int>
+spec_iv_value(CodeFragment &code, SpecIv &spec, const ArgType &arg) {
+    if (auto iv = std::get_if<RawIv>(&arg))
+        return iv->local_index;
+    SpecInsn load{SpecOp::Load};
+    std::ostringstream sv;
+    if (auto psv = std::get_if<PadSv>(&arg)) {
+        auto var = code.get_local_sv(*psv);
+        sv << var;
+        if (std::find(spec.stored.begin(), spec.stored.end(),
+                      var.local_index) == spec.stored.end() &&
+            spec.guard("guard_iv_read(" + sv.str() + ")"))
+            spec.inputs.push_back(arg);
+    } else if (auto ssv = std::get_if<StackSv>(&arg)) {
+        sv << *ssv;
+        load.stack = true;
+        if (spec.guard("guard_iv_read(" + sv.str() + ")"))
+            spec.inputs.push_back(arg);
+    } else if (auto lsv = std::get_if<LocalSv>(&arg)) {
+        // a variable we stored an IV in
+        if (std::find(spec.stored.begin(), spec.stored.end(),
+                      lsv->local_index) == spec.stored.end())
+            return std::nullopt;
+        sv << *lsv;
+    } else {
+        return std::nullopt;
+    }
+    load.sv = sv.str();
+    return spec.add(code, std::move(load));
+}
+
+// store iv, the local index of an IV, in the pad scalar targ for the
+// IV specialisation, returning the variable
+LocalSv
+spec_store(CodeFragment &code, SpecIv &spec, PADOFFSET targ, int iv) {
+    auto var = code.get_local_sv(PadSv{targ});
+    std::ostringstream sv;
+    sv << var;
+    spec.guard("guard_iv_store(" + sv.str() + ")");
+    SpecInsn store{SpecOp::Store, -1, {iv}};
+    store.sv = sv.str();
+    spec.insns.push_back(std::move(store));
+    spec.stored.push_back(var.local_index);
+    return var;
+}
+
+// push result, the local index of the result of o for the IV
+// specialisation, storing it first if o assigns to lhs, as
+// "$x += ..." does, or writes to a lexical directly, as
+// "$x = $y + ..." may be optimised to
+bool
+spec_push(OP *o, CodeFragment &code, SpecIv &spec, Stack &stack,
+          const ArgType &lhs, int result) {
+    ArgType out = RawIv{result, o->op_targ};
+    if (o->op_flags & OPf_STACKED) {
+        auto var = std::get_if<PadSv>(&lhs);
+        if (!var)
+            return false;
+        out = spec_store(code, spec, var->index, result);
+    } else if (is_mutator(o)) {
+        out = spec_store(code, spec, o->op_targ, result);
+    }
+
+    // only push a result if non-void
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(std::move(out));
+    return true;
+}
+
+// add an IV specialised binop or comparison
+bool
+spec_binop(OP *o, CodeFragment &code, SpecIv &spec, Stack &stack,
+           SpecOp op) {
+    auto right = spec_iv_value(code, spec, stack.pop());
+    auto lhs = stack.pop();
+    auto left = spec_iv_value(code, spec, lhs);
+    if (!left || !right)
+        return false;
+    SpecInsn insn{op, -1, {*left, *right}};
+    if (!insn.is_bool())
+        return spec_push(o, code, spec, stack, lhs, spec.add(code, insn));
+    auto result = spec.add(code, insn);
+    if (OP_GIMME(o, OPf_WANT_SCALAR) != OPf_WANT_VOID)
+        stack.push(RawBool{result});
+    return true;
+}
+
+// add an IV specialised unop
+bool
+spec_unop(OP *o, CodeFragment &code, SpecIv &spec, Stack &stack,
+          SpecOp op) {
+    auto arg = stack.pop();
+    auto iv = spec_iv_value(code, spec, arg);
+    if (!iv)
+        return false;
+    return spec_push(o, code, spec, stack, arg,
+                     spec.add(code, SpecInsn{op, -1, {*iv}}));
+}
+
+// add the steps for a single op for the IV specialisation
+//
+// returns false if the op isn't supported
+bool
+compile_spec_op(pTHX_ OP *o, CodeFragment &code, SpecIv &spec,
+                Stack &stack) {
+    switch (o->op_type) {
+    case OP_CONST: {
+        SV *sv = cSVOPx_sv(o);
+        if (!sv || !SvIOK(sv) || SvIsUV(sv) ||
+            (SvFLAGS(sv) & (SVf_NOK | SVf_POK | SVf_ROK | SVs_GMG)))
+            return false;
+        SpecInsn insn{SpecOp::Const};
+        insn.value = SvIVX(sv);
+        stack.push(RawIv{spec.add(code, insn), 0});
+    } break;
+
+    case OP_PADSV:
+        // the variable is read by the op using it
+        if (!is_simple_padsv(o) || (o->op_private & OPpDEREF))
+            return false;
+        if (o->op_private & OPpLVAL_INTRO) {
+            SpecInsn clear{SpecOp::ClearSv};
+            clear.targ = o->op_targ;
+            spec.insns.push_back(clear);
+        }
+        stack.push(PadSv{o->op_targ});
+        break;
+
+    case OP_SASSIGN: {
+        if (!is_simple_assign(o))
+            return false;
+        auto lhs = stack.pop();
+        auto var = std::get_if<PadSv>(&lhs);
+        auto iv = spec_iv_value(code, spec, stack.pop());
+        if (!var || !iv)
+            return false;
+        auto out = spec_store(code, spec, var->index, *iv);
+        if ((o->op_flags & OPf_WANT) != OPf_WANT_VOID)
+            stack.push(out);
+    } break;
+
+#if PERL_VERSION_GE(5, 38, 0)
+    case OP_PADSV_STORE: {
+        auto iv = spec_iv_value(code, spec, stack.pop());
+        if (!iv)
+            return false;
+        if ((o->op_private & (OPpLVAL_INTRO | OPpPAD_STATE)) ==
+            OPpLVAL_INTRO) {
+            SpecInsn clear{SpecOp::ClearSv};
+            clear.targ = o->op_targ;
+            spec.insns.push_back(clear);
+        }
+        auto out = spec_store(code, spec, o->op_targ, *iv);
+        if ((o->op_flags & OPf_WANT) != OPf_WANT_VOID)
+            stack.push(out);
+    } break;
+#endif
+
+    case OP_ADD:
+        return spec_binop(o, code, spec, stack, SpecOp::Add);
+
+    case OP_SUBTRACT:
+        return spec_binop(o, code, spec, stack, SpecOp::Subtract);
+
+    case OP_MULTIPLY:
+        return spec_binop(o, code, spec, stack, SpecOp::Multiply);
+
+    case OP_I_ADD:
+        return spec_binop(o, code, spec, stack, SpecOp::IAdd);
+
+    case OP_I_SUBTRACT:
+        return spec_binop(o, code, spec, stack, SpecOp::ISubtract);
+
+    case OP_I_MULTIPLY:
+        return spec_binop(o, code, spec, stack, SpecOp::IMultiply);
+
+    case OP_I_DIVIDE:
+        return spec_binop(o, code, spec, stack, SpecOp::IDivide);
+
+    case OP_I_MODULO:
+        return spec_binop(o, code, spec, stack, SpecOp::IModulo);
+
+    case OP_NEGATE:
+        return spec_unop(o, code, spec, stack, SpecOp::Negate);
+
+    case OP_ABS:
+        return spec_unop(o, code, spec, stack, SpecOp::Abs);
+
+    case OP_I_NEGATE:
+        return spec_unop(o, code, spec, stack, SpecOp::INegate);
+
+    case OP_LT:
+    case OP_I_LT:
+        return spec_binop(o, code, spec, stack, SpecOp::Lt);
+
+    case OP_GT:
+    case OP_I_GT:
+        return spec_binop(o, code, spec, stack, SpecOp::Gt);
+
+    case OP_LE:
+    case OP_I_LE:
+        return spec_binop(o, code, spec, stack, SpecOp::Le);
+
+    case OP_GE:
+    case OP_I_GE:
+        return spec_binop(o, code, spec, stack, SpecOp::Ge);
+
+    case OP_EQ:
+    case OP_I_EQ:
+        return spec_binop(o, code, spec, stack, SpecOp::Eq);
+
+    case OP_NE:
+    case OP_I_NE:
+        return spec_binop(o, code, spec, stack, SpecOp::Ne);
+
+    case OP_NCMP:
+    case OP_I_NCMP:
+        return spec_binop(o, code, spec, stack, SpecOp::Ncmp);
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+// forwarding: a variable read after we stored to it, or read before,
+// is the value we stored or read.  Only our own stores can change
+// them, but any other variable or stack entry might be the SV we
+// store to, so a store forgets what was read.
+void
+spec_forward(SpecIv &spec, Stack &stack) {
+    my_map<std::string, int> vars;
+    my_map<std::string, int> entries;
+    for (auto &insn : spec.insns) {
+        if (insn.op == SpecOp::Store) {
+            // any other variable may be the same SV, as the variable
+            // of a foreach is for the list it loops over
+            vars.clear();
+            vars.emplace(insn.sv, insn.args[0]);
+            entries.clear();
+        } else if (insn.op == SpecOp::Load) {
+            auto &known = insn.stack ? entries : vars;
+            auto found = known.find(insn.sv);
+            if (found != known.end()) {
+                spec.replace(insn.result, found->second, stack);
+                insn.dead = true;
+            } else {
+                known.emplace(insn.sv, insn.result);
+            }
+        }
+    }
+}
+
+// the result of op on constant operands, or nullopt if it has to be
+// left to run time, where it goes to the generic code or croaks
+std::optional<IV>
+spec_fold_value(SpecOp op, IV left, IV right) {
+    IV result;
+    switch (op) {
+    case SpecOp::Add:
+        if (__builtin_add_overflow(left, right, &result))
+            return std::nullopt;
+        return result;
+    case SpecOp::Subtract:
+        if (__builtin_sub_overflow(left, right, &result))
+            return std::nullopt;
+        return result;
+    case SpecOp::Multiply:
+        if (__builtin_mul_overflow(left, right, &result))
+            return std::nullopt;
+        return result;
+    case SpecOp::Negate:
+    case SpecOp::Abs:
+        if (left == IV_MIN)
+            return std::nullopt;
+        return op == SpecOp::Negate || left < 0 ? -left : left;
+    case SpecOp::IAdd:
+        return (IV)((UV)left + (UV)right);
+    case SpecOp::ISubtract:
+        return (IV)((UV)left - (UV)right);
+    case SpecOp::IMultiply:
+        return (IV)((UV)left * (UV)right);
+    case SpecOp::IDivide:
+        if (right == 0)
+            return std::nullopt;
+        return right == -1 ? (IV)-(UV)left : left / right;
+    case SpecOp::IModulo:
+        if (right == 0)
+            return std::nullopt;
+        return right == -1 ? 0 : left % right;
+    case SpecOp::INegate:
+        return (IV)-(UV)left;
+    case SpecOp::Ncmp:
+        return (left > right) - (left < right);
+    case SpecOp::Lt:
+        return left < right;
+    case SpecOp::Gt:
+        return left > right;
+    case SpecOp::Le:
+        return left <= right;
+    case SpecOp::Ge:
+        return left >= right;
+    case SpecOp::Eq:
+        return left == right;
+    case SpecOp::Ne:
+        return left != right;
+    default:
+        return std::nullopt;
+    }
+}
+
+// constant folding: work out the results of steps on constants
+void
+spec_fold(SpecIv &spec, Stack &) {
+    my_map<int, IV> consts;
+    for (auto &insn : spec.insns) {
+        if (insn.op == SpecOp::Const || insn.op == SpecOp::BoolConst) {
+            consts.emplace(insn.result, insn.value);
+            continue;
+        }
+        if (insn.result < 0 || insn.args.empty())
+            continue;
+        IV values[2] = {0, 0};
+        size_t found = 0;
+        for (; found < insn.args.size(); ++found) {
+            auto value = consts.find(insn.args[found]);
+            if (value == consts.end())
+                break;
+            values[found] = value->second;
+        }
+        if (found != insn.args.size())
+            continue;
+        auto value = spec_fold_value(insn.op, values[0], values[1]);
+        if (!value)
+            continue;
+        insn.op = insn.is_bool() ? SpecOp::BoolConst : SpecOp::Const;
+        insn.value = *value;
+        insn.args.clear();
+        consts.emplace(insn.result, *value);
+    }
+}
+
+// common subexpressions: a step repeating an earlier one uses its
+// result.  Where the earlier step would go to the generic code it
+// already has.
+void
+spec_cse(SpecIv &spec, Stack &stack) {
+    std::map<std::tuple<SpecOp, std::vector<int>, IV>, int> seen;
+    for (auto &insn : spec.insns) {
+        if (insn.result < 0 || insn.op == SpecOp::Load)
+            continue;
+        auto args = insn.args;
+        switch (insn.op) {
+        case SpecOp::Add:
+        case SpecOp::Multiply:
+        case SpecOp::IAdd:
+        case SpecOp::IMultiply:
+        case SpecOp::Eq:
+        case SpecOp::Ne:
+            std::sort(args.begin(), args.end());
+            break;
+        default:
+            break;
+        }
+        auto [found, added] = seen.try_emplace(
+            std::tuple{insn.op, std::move(args), insn.value}, insn.result);
+        if (!added) {
+            spec.replace(insn.result, found->second, stack);
+            insn.dead = true;
+        }
+    }
+}
+
+// dead code: remove steps whose results aren't used, unless they
+// have an effect or might croak
+void
+spec_dce(SpecIv &spec, Stack &stack) {
+    my_map<int, int> uses;
+    for (auto &item : stack) {
+        if (auto iv = std::get_if<RawIv>(&item))
+            ++uses[iv->local_index];
+        else if (auto b = std::get_if<RawBool>(&item))
+            ++uses[b->local_index];
+    }
+    for (auto &insn : spec.insns) {
+        for (int arg : insn.args)
+            ++uses[arg];
+    }
+    for (auto insn = spec.insns.rbegin(); insn != spec.insns.rend();
+         ++insn) {
+        if (insn->needed() || uses[insn->result])
+            continue;
+        insn->dead = true;
+        for (int arg : insn->args)
+            --uses[arg];
+    }
+}
+
+// an optimisation pass over the IV specialisation
+struct SpecPass {
+    const char *name;
+    void (*run)(SpecIv &spec, Stack &stack);
+};
+
+// the available passes, in the default order
+const SpecPass spec_pass_list[] = {
+    {"forward", spec_forward},
+    {"fold", spec_fold},
+    {"cse", spec_cse},
+    {"dce", spec_dce},
+};
+
+// the passes to run, see PERL_FMC_PASSES
+std::vector<const SpecPass *> spec_passes;
 
-        case OP_SUBTRACT:
-            add_binop(aTHX_ o, code, stack, "do_subtract", "-");
-            break;
+void
+init_spec_passes(pTHX) {
+    const char *env = getenv("PERL_FMC_PASSES");
+    if (!env) {
+        for (auto &pass : spec_pass_list)
+            spec_passes.push_back(&pass);
+        return;
+    }
+    std::string_view names{env};
+    while (!names.empty()) {
+        auto comma = names.find(',');
+        auto name = names.substr(0, comma);
+        names = comma == names.npos ? "" : names.substr(comma + 1);
+        if (name.empty())
+            continue;
+        auto pass = std::find_if(
+            std::begin(spec_pass_list), std::end(spec_pass_list),
+            [&](const SpecPass &pass) { return name == pass.name; });
+        if (pass == std::end(spec_pass_list))
+            warn("PERL_FMC_PASSES: unknown pass '%.*s'", (int)name.size(),
+                 name.data());
+        else
+            spec_passes.push_back(pass);
+    }
+}
 
-        case OP_MULTIPLY:
-            add_binop(aTHX_ o, code, stack, "do_multiply", "*");
-            break;
+void
+dump_spec(const SpecIv &spec, std::string_view after) {
+    std::cerr << "IV specialisation " << after << ":\n";
+    for (auto &insn : spec.insns)
+        std::cerr << "  " << insn << "\n";
+}
 
-        case OP_DIVIDE:
-            add_binop(aTHX_ o, code, stack, "do_divide", "/");
+// generate the C for the steps of the IV specialisation
+void
+spec_emit(CodeFragment &code, const SpecIv &spec) {
+    for (auto &insn : spec.insns) {
+        RawIv result{insn.result, 0};
+        auto arg = [&](size_t i) { return RawIv{insn.args[i], 0}; };
+        const char *func = nullptr;
+        const char *cmp = nullptr;
+        switch (insn.op) {
+        case SpecOp::Load:
+            code << "IV " << result << " = SvIVX(" << insn.sv << ");\n";
+            break;
+        case SpecOp::Const:
+            code << "IV " << result << " = " << iv_literal(insn.value)
+                 << ";\n";
+            break;
+        case SpecOp::BoolConst:
+            code << "bool " << RawBool{insn.result} << " = "
+                 << (insn.value ? "true" : "false") << ";\n";
+            break;
+        case SpecOp::Add:
+            func = "my_iv_add_may_overflow";
+            [[fallthrough]];
+        case SpecOp::Subtract:
+            func = func ? func : "my_iv_sub_may_overflow";
+            [[fallthrough]];
+        case SpecOp::Multiply:
+            func = func ? func : "my_iv_mul_may_overflow";
+            code << "IV " << result << ";\nif (" << func << "(" << arg(0)
+                 << ", " << arg(1) << ", &" << result
+                 << "))\n    goto generic;\n";
+            break;
+        case SpecOp::Negate:
+        case SpecOp::Abs:
+            // perl's result for IV_MIN is a UV
+            code << "if (" << arg(0) << " == IV_MIN)\n    goto generic;\n";
+            code << "IV " << result << " = ";
+            if (insn.op == SpecOp::Negate)
+                code << "-" << arg(0);
+            else
+                code << arg(0) << " < 0 ? -" << arg(0) << " : " << arg(0);
+            code << ";\n";
+            break;
+        case SpecOp::IAdd:
+            func = "do_i_add_raw";
+            [[fallthrough]];
+        case SpecOp::ISubtract:
+            func = func ? func : "do_i_subtract_raw";
+            [[fallthrough]];
+        case SpecOp::IMultiply:
+            func = func ? func : "do_i_multiply_raw";
+            [[fallthrough]];
+        case SpecOp::IDivide:
+            func = func ? func : "do_i_divide_raw";
+            [[fallthrough]];
+        case SpecOp::IModulo:
+            func = func ? func : "do_i_modulo_raw";
+            code << "IV " << result << " = " << func << "(aTHX_ " << arg(0)
+                 << ", " << arg(1) << ");\n";
             break;
+        case SpecOp::INegate:
+            code << "IV " << result << " = do_i_negate_raw(aTHX_ " << arg(0)
+                 << ");\n";
+            break;
+        case SpecOp::Ncmp:
+            code << "IV " << result << " = do_i_ncmp_raw(" << arg(0) << ", "
+                 << arg(1) << ");\n";
+            break;
+        case SpecOp::Lt:
+            cmp = "<";
+            [[fallthrough]];
+        case SpecOp::Gt:
+            cmp = cmp ? cmp : ">";
+            [[fallthrough]];
+        case SpecOp::Le:
+            cmp = cmp ? cmp : "<=";
+            [[fallthrough]];
+        case SpecOp::Ge:
+            cmp = cmp ? cmp : ">=";
+            [[fallthrough]];
+        case SpecOp::Eq:
+            cmp = cmp ? cmp : "==";
+            [[fallthrough]];
+        case SpecOp::Ne:
+            cmp = cmp ? cmp : "!=";
+            code << "bool " << RawBool{insn.result} << " = " << arg(0) << " "
+                 << cmp << " " << arg(1) << ";\n";
+            break;
+        case SpecOp::Store:
+            code << "fast_sv_setiv(aTHX_ " << insn.sv << ", " << arg(0)
+                 << ");\n";
+            break;
+        case SpecOp::ClearSv:
+            add_clearsv(code, insn.targ);
+            break;
+        }
+    }
+}
 
-        case OP_NEGATE:
-            add_unop(aTHX_ o, code, stack, "do_negate", "-");
+// generate the IV specialisation of the ops from start to final, see
+// SpecIv, with its entry check
+//
+// returns false if the ops can't be specialised
+bool
+compile_spec_iv(pTHX_ CodeFragment &code, SpecIv &spec, OP *start,
+                OP *final) {
+    Stack stack;
+    bool ok = true;
+    for (OP *o = start; ok; o = o->op_next) {
+        ok = o && compile_spec_op(aTHX_ o, code, spec, stack);
+        if (o == final)
             break;
+    }
+    // nothing to check means nothing is read from an SV
+    if (!ok || spec.guards.empty())
+        return false;
 
-        default:
-            croak("ARGH unsure how to optimize this op\n");
+    bool dump = DebugFlags(CCDebugFlags::DumpIr);
+    if (dump)
+        dump_spec(spec, "built");
+    for (auto pass : spec_passes) {
+        pass->run(spec, stack);
+        std::erase_if(spec.insns, [](const SpecInsn &insn) {
+            return insn.dead;
+        });
+        if (dump)
+            dump_spec(spec, std::string("after ") + pass->name);
+    }
+
+    // nothing visible can have happened before going to the generic
+    // code
+    bool effects = false;
+    for (auto &insn : spec.insns) {
+        if (insn.checked()) {
+            if (effects)
+                return false;
+            spec.deopts = true;
         }
+        effects = effects || insn.effects();
+    }
+
+    auto body = code.capture([&] {
+        spec_emit(code, spec);
+        push_results(code, stack);
+        code << "return NULL;\n";
+    });
+    code << "if (";
+    for (size_t i = 0; i < spec.guards.size(); ++i)
+        code << (i ? " &&\n    " : "") << spec.guards[i];
+    code << ") {\n" << body << "}\n";
+    return true;
+}
+
+// record the inputs of the fragment being generated for profiling
+void
+add_profile_inputs(const CodeFragment &code, const SpecIv &spec) {
+    if (profile_fragments.size() <= static_cast<size_t>(CodeIndex))
+        profile_fragments.resize(CodeIndex + 1);
+    auto &frag = profile_fragments[CodeIndex];
+    frag.file = code.file;
+    frag.line = code.line;
+    frag.inputs.clear();
+    for (auto &arg : spec.inputs) {
+        ProfileInput input;
+        if (auto ssv = std::get_if<StackSv>(&arg)) {
+            input.stack = true;
+            input.index = ssv->offset;
+        } else {
+            input.index = std::get<PadSv>(arg).index;
+        }
+        frag.inputs.push_back(input);
+    }
+}
+
+// the entry for the fragment being generated in
+// %Faster::Maths::CC::profile, if it's for the same code
+HV *
+profile_entry(pTHX_ const CodeFragment &code, size_t inputs) {
+    HV *profile = get_hv("Faster::Maths::CC::profile", 0);
+    if (!profile)
+        return nullptr;
+    auto key = std::to_string(CodeIndex);
+    SV **entry = hv_fetch(profile, key.c_str(), key.size(), 0);
+    if (!entry || !SvROK(*entry) || SvTYPE(SvRV(*entry)) != SVt_PVHV)
+        return nullptr;
+    HV *hv = (HV *)SvRV(*entry);
+    SV **file = hv_fetchs(hv, "file", 0);
+    SV **line = hv_fetchs(hv, "line", 0);
+    SV **ins = hv_fetchs(hv, "inputs", 0);
+    if (!file || !line || !ins || strNE(SvPV_nolen(*file), code.file) ||
+        SvUV(*line) != code.line || !SvROK(*ins) ||
+        SvTYPE(SvRV(*ins)) != SVt_PVAV ||
+        av_count((AV *)SvRV(*ins)) != inputs)
+        return nullptr;
+    return hv;
+}
+
+// should the fragment being generated get the IV specialisation?
+//
+// Yes, unless a profile from an earlier run found one of its inputs
+// wasn't an IV most of the time, when the entry check would usually
+// fail.
+bool
+profile_wants_spec(pTHX_ const CodeFragment &code, const SpecIv &spec) {
+    HV *entry = profile_entry(aTHX_ code, spec.inputs.size());
+    if (!entry)
+        return true;
+    AV *inputs = (AV *)SvRV(*hv_fetchs(entry, "inputs", 0));
+    for (SSize_t i = 0; i <= av_top_index(inputs); ++i) {
+        SV **counts = av_fetch(inputs, i, 0);
+        if (!counts || !SvROK(*counts) ||
+            SvTYPE(SvRV(*counts)) != SVt_PVHV)
+            continue;
+        HV *hv = (HV *)SvRV(*counts);
+        UV total = 0;
+        UV ivs = 0;
+        hv_iterinit(hv);
+        while (HE *he = hv_iternext(hv)) {
+            STRLEN len;
+            const char *kind = HePV(he, len);
+            UV count = SvUV(HeVAL(he));
+            total += count;
+            if (strEQ(kind, "iv"))
+                ivs = count;
+        }
+        if (total && ivs * 2 <= total) {
+            logln(CCDebugFlags::Failures,
+                  "profile: input {} of {}:{} is mostly not an IV", i,
+                  code.file, code.line);
+            return false;
+        }
+    }
+    return true;
+}
+
+// given a sequence of ops, generate C a C code fragment
+void
+compile_code(pTHX_ CodeFragment &code, OP *start, OP *final, OP *prev) {
+    // with "+float" the generic code already works on C values, and
+    // those are NVs
+    if (!code.use_float) {
+        // try it quietly first, so a failure leaves nothing behind
+        CodeFragment trial{aTHX_ code.cop, nullptr, true};
+        SpecIv trial_spec;
+        if (compile_spec_iv(aTHX_ trial, trial_spec, start, final)) {
+            if (profiling)
+                add_profile_inputs(code, trial_spec);
+            SpecIv spec;
+            if (profile_wants_spec(aTHX_ code, trial_spec) &&
+                compile_spec_iv(aTHX_ code, spec, start, final) &&
+                spec.deopts)
+                code << "generic:;\n";
+        }
+    }
+
+    Stack stack;
+    OP *oprev = NULL;
+    for (OP *o = start; o; o = o->op_next) {
+        if (!compile_op(aTHX_ o, code, stack))
+            croak("ARGH unsure how to optimize this op\n");
         oprev = o;
         if (o == final)
             break;
@@ -867,6 +4126,507 @@ compile_code(pTHX_ CodeFragment &code, OP *start, OP *final, OP *prev) {
     return;
 }
 
+// does the op tree o contain an op of type type?
+bool
+contains_op(const OP *o, OPCODE type) {
+    if (o->op_type == type)
+        return true;
+    if (o->op_flags & OPf_KIDS) {
+        for (const OP *kid = cUNOPx(o)->op_first; kid; kid = OpSIBLING(kid)) {
+            if (contains_op(kid, type))
+                return true;
+        }
+    }
+    return false;
+}
+
+// a loop being compiled, used to resolve next/last/redo
+struct LoopInfo {
+    LoopInfo(int id_, OP *enter)
+        : id(id_), redoop(cLOOPx(enter)->op_redoop),
+          nextop(cLOOPx(enter)->op_nextop), leave(cLOOPx(enter)->op_lastop),
+          head(enter->op_next), has_redo(contains_op(leave, OP_REDO)) {}
+    int id;       // used to make unique label names
+    OP *redoop;   // start of the loop body
+    OP *nextop;   // where "next" goes, the continue block or the unstack
+    OP *leave;    // the OP_LEAVELOOP
+    OP *head;     // the first op of each iteration
+    bool has_redo = false; // the body might contain a redo
+    bool used_next = false;
+    bool used_redo = false;
+    bool seen_next = false;
+    bool seen_redo = false;
+};
+
+bool compile_loop(pTHX_ CodeFragment &code, OP *enter);
+
+// generate code for "return LIST" where the LIST is made of ops we
+// can compile, the values are pushed and the fragment returns the
+// OP_RETURN for perl to run.
+//
+// returns the OP_RETURN, or nullptr on failure
+OP *
+compile_return(pTHX_ CodeFragment &code, OP *pushmark) {
+    Stack stack;
+    OP *o = pushmark->op_next;
+    for (; o && o->op_type != OP_RETURN; o = o->op_next) {
+        if (!compile_op(aTHX_ o, code, stack))
+            return nullptr;
+    }
+    if (!o || stack.over_popped)
+        return nullptr;
+
+    for (auto &item : stack) {
+        if (is_raw(item))
+            item = code.box_raw(item);
+    }
+    code << "PUSHMARK(PL_stack_sp);\n";
+    if (stack.size() != 0)
+        code << "rpp_extend(" << stack.size() << ");\n";
+    for (auto item : stack) {
+        code << "rpp_push_1(" << item << ");\n";
+    }
+    code << "return (OP *)aux[" << code.save_aux_op(o) << "].pv;\n";
+
+    return o;
+}
+
+// generate the jump for o, an unlabelled next, last or redo
+bool
+add_loop_control(CodeFragment &code, LoopInfo &loop, OP *o) {
+    if (!(o->op_flags & OPf_SPECIAL))
+        return false;
+    if (o->op_type == OP_NEXT) {
+        code << "goto next_" << loop.id << ";\n";
+        loop.used_next = true;
+    } else if (o->op_type == OP_LAST) {
+        code << "goto last_" << loop.id << ";\n";
+    } else {
+        code << "goto redo_" << loop.id << ";\n";
+        loop.used_redo = true;
+    }
+    return true;
+}
+
+// does o, the other branch of a conditional, leave the loop
+// iteration with an unlabelled next, last or redo, or a return?
+bool
+is_loop_exit(OP *o) {
+    switch (o->op_type) {
+    case OP_NEXT:
+    case OP_LAST:
+    case OP_REDO:
+        return o->op_flags & OPf_SPECIAL;
+    case OP_PUSHMARK:
+        return op_parent(o) && op_parent(o)->op_type == OP_RETURN;
+    }
+    return false;
+}
+
+// generate code for the statements from start until the end of
+// the loop body
+bool
+compile_loop_body(pTHX_ CodeFragment &code, LoopInfo &loop, OP *start) {
+    Stack stack;
+    OP *o = start;
+    while (o) {
+        if (o == loop.redoop) {
+            code << "redo_" << loop.id << ":;\n";
+            loop.seen_redo = true;
+            // a redo skips the loop condition
+            if (loop.has_redo)
+                code.shared.clear();
+        }
+        if (o == loop.nextop) {
+            code << "next_" << loop.id << ":;\n";
+            loop.seen_next = true;
+            // a next skips the rest of the body
+            code.shared.clear();
+        }
+        if (o == loop.leave) {
+            // a bare block, we only go around once
+            code << "break;\n";
+            return true;
+        }
+        switch (o->op_type) {
+        case OP_NEXTSTATE: {
+            if (stack.over_popped)
+                return false;
+            stack = Stack{};
+            const COP *cop = cCOPo;
+            if (!cop_bool_config(aTHX_ cop, "Faster::Maths::CC/faster"))
+                return false;
+            code.set_cop(aTHX_ cop);
+            code << "PL_curcop = (COP *)aux[" << code.save_aux_op(o)
+                 << "].pv; // line " << CopLINE(cop) << "\n";
+            code << "TAINT_NOT;\nFREETMPS;\n";
+        } break;
+
+        case OP_UNSTACK:
+            // the end of an iteration
+            if (o->op_next != loop.head)
+                return false;
+            code << "FREETMPS;\nPERL_ASYNC_CHECK();\n";
+            return true;
+
+        case OP_ENTER:
+        case OP_LEAVE:
+            // nothing we compile needs the scope
+            if ((o->op_flags & OPf_WANT) != OPf_WANT_VOID)
+                return false;
+            break;
+
+        case OP_NEXT:
+        case OP_LAST:
+        case OP_REDO:
+            if (!add_loop_control(code, loop, o))
+                return false;
+            break;
+
+        case OP_PUSHMARK:
+        case OP_PADRANGE:
+            // a call we make directly, a list assignment or a return
+            if (list_assign_op(o)) {
+                // "my (...)" would need the scope cleanup, as for
+                // OP_PADSV below
+                if (o->op_type == OP_PADRANGE &&
+                    (o->op_private & OPpLVAL_INTRO))
+                    return false;
+                if (!compile_op(aTHX_ o, code, stack))
+                    return false;
+                break;
+            }
+            if (direct_call_entersub(aTHX_ o)) {
+                if (!compile_op(aTHX_ o, code, stack))
+                    return false;
+                break;
+            }
+            if (o->op_type != OP_PUSHMARK)
+                return false;
+            o = compile_return(aTHX_ code, o);
+            if (!o)
+                return false;
+            break;
+
+        case OP_ENTERLOOP:
+            if (!compile_loop(aTHX_ code, o))
+                return false;
+            o = cLOOPo->op_lastop;
+            break;
+
+        case OP_AND:
+        case OP_OR:
+            // "--$count or return undef;", "$x > 10 and last;"
+            if ((o->op_flags & OPf_WANT) == OPf_WANT_VOID &&
+                is_loop_exit(cLOGOPo->op_other)) {
+                auto cond = code.simplify_num(stack.pop());
+                code << "if (" << (o->op_type == OP_OR ? "!" : "")
+                     << AsBool{cond} << ") {\n";
+                auto shared = code.shared;
+                OP *other = cLOGOPo->op_other;
+                if (other->op_type == OP_PUSHMARK
+                        ? !compile_return(aTHX_ code, other)
+                        : !add_loop_control(code, loop, other))
+                    return false;
+                code << "}\n";
+                code.shared = std::move(shared);
+                break;
+            }
+            if (!compile_op(aTHX_ o, code, stack))
+                return false;
+            break;
+
+        case OP_PADSV:
+#if PERL_VERSION_GE(5, 38, 0)
+        case OP_PADSV_STORE:
+#endif
+            // "my $x" would need the scope cleanup pp_unstack does for
+            // each iteration
+            if (o->op_private & OPpLVAL_INTRO)
+                return false;
+            [[fallthrough]];
+
+        default:
+            if (!compile_op(aTHX_ o, code, stack)) {
+                if (!code.quiet)
+                    logln(CCDebugFlags::Failures, "loop: can't compile op {}",
+                          OpPtr{o});
+                return false;
+            }
+            break;
+        }
+        o = o->op_next;
+    }
+
+    return false;
+}
+
+// generate code for a while/until/for(;;) loop or a bare block,
+// including any nested loops
+bool
+compile_loop_code(pTHX_ CodeFragment &code, OP *enter) {
+    LoopInfo loop{code.loop_count++, enter};
+    if ((loop.leave->op_flags & OPf_WANT) != OPf_WANT_VOID)
+        return false;
+
+    // values computed in the loop are only in scope within it
+    auto shared = code.shared;
+    code << "for (;;) {\n";
+    OP *o = loop.head;
+    if (o != loop.redoop) {
+        // the loop condition
+        Stack stack;
+        for (; o && o != loop.leave; o = o->op_next) {
+            if ((o->op_type == OP_AND || o->op_type == OP_OR) &&
+                cLOGOPo->op_other == loop.redoop && o->op_next == loop.leave)
+                break;
+            if (!compile_op(aTHX_ o, code, stack))
+                return false;
+        }
+        if (o == nullptr || o == loop.leave || stack.size() != 1)
+            return false;
+
+        auto cond = stack.pop();
+        code << "if (" << (o->op_type == OP_AND ? "!" : "") << AsBool{cond}
+             << ")\n    break;\n";
+    }
+    if (!compile_loop_body(aTHX_ code, loop, loop.redoop))
+        return false;
+
+    // make sure any labels we jump to were generated
+    if ((loop.used_next && !loop.seen_next) ||
+        (loop.used_redo && !loop.seen_redo))
+        return false;
+
+    code << "}\n";
+    code << "last_" << loop.id << ":;\n";
+    code.shared = std::move(shared);
+
+    return true;
+}
+
+// find the scalar lexicals read by o and its kids, and those that
+// might be stored to, nested is set if there's a nested loop
+void
+find_pad_uses(const OP *o, std::vector<PADOFFSET> &reads,
+              std::vector<PADOFFSET> &writes, bool &nested) {
+    switch (o->op_type) {
+    case OP_NULL:
+        // op_targ is the type the op had
+        break;
+    case OP_LEAVELOOP:
+        nested = true;
+        break;
+    case OP_PADSV:
+        if ((o->op_flags & OPf_MOD) ||
+            (o->op_private & (OPpLVAL_INTRO | OPpDEREF)))
+            writes.push_back(o->op_targ);
+        else
+            reads.push_back(o->op_targ);
+        break;
+    case OP_PADRANGE: {
+        int count = o->op_private & OPpPADRANGE_COUNTMASK;
+        for (int i = 0; i < count; ++i)
+            writes.push_back(o->op_targ + i);
+    } break;
+    default:
+        // an op's own target is a temporary, but an op can also store
+        // its result directly in a lexical, as "$x = $y + 1" does
+        if (o->op_targ)
+            writes.push_back(o->op_targ);
+        break;
+    }
+    if (o->op_flags & OPf_KIDS) {
+        for (const OP *kid = cUNOPx(o)->op_first; kid; kid = OpSIBLING(kid))
+            find_pad_uses(kid, reads, writes, nested);
+    }
+}
+
+// the scalar lexicals the loop ending at leave reads but never stores
+// to, sorted by pad index
+//
+// Loops with nested loops aren't considered, since each loop that uses
+// these would be generated twice.
+std::vector<PADOFFSET>
+loop_invariants(OP *leave) {
+    std::vector<PADOFFSET> reads, writes;
+    bool nested = false;
+    // skip the OP_ENTERLOOP
+    for (const OP *kid = OpSIBLING(cBINOPx(leave)->op_first); kid;
+         kid = OpSIBLING(kid))
+        find_pad_uses(kid, reads, writes, nested);
+    if (nested)
+        return {};
+    std::erase_if(reads, [&](PADOFFSET index) {
+        return std::find(writes.begin(), writes.end(), index) != writes.end();
+    });
+    std::sort(reads.begin(), reads.end());
+    reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+    return reads;
+}
+
+// generate code for a loop
+//
+// Without overloading the variables the loop only reads are read as
+// numbers each time they're used, though their values can't change.
+// So the loop is generated twice: once using the NVs (or IVs, without
+// "+float") of those variables read before it starts, and once as
+// normal.  The first version is used if those variables hold plain
+// numbers and nothing else refers to them, see guard_invariant_nv().
+bool
+compile_loop(pTHX_ CodeFragment &code, OP *enter) {
+    std::vector<PADOFFSET> vars;
+    if (!code.overloading && code.invariants.empty())
+        vars = loop_invariants(cLOOPx(enter)->op_lastop);
+    if (vars.empty())
+        return compile_loop_code(aTHX_ code, enter);
+
+    bool nv = code.use_float;
+    for (auto index : vars) {
+        code.invariants.emplace(index, nv ? ArgType{code.make_raw_nv(0)}
+                                          : ArgType{code.make_raw_iv(0)});
+    }
+    // the loop's statements update the hints
+    bool overloading = code.overloading;
+    bool use_float = code.use_float;
+    bool ok = true;
+    auto hoisted = code.capture(
+        [&] { ok = compile_loop_code(aTHX_ code, enter); });
+    auto used = std::move(code.invariants_used);
+    auto invariants = std::move(code.invariants);
+    code.invariants.clear();
+    code.invariants_used.clear();
+    code.overloading = overloading;
+    code.use_float = use_float;
+    if (!ok)
+        return false;
+    if (used.empty())
+        return compile_loop_code(aTHX_ code, enter);
+
+    std::sort(used.begin(), used.end());
+    std::vector<LocalSv> svs;
+    for (auto index : used)
+        svs.push_back(code.get_local_sv(PadSv{index}));
+    code << "if (";
+    for (size_t i = 0; i < svs.size(); ++i) {
+        code << (i ? " &&\n    " : "") << "guard_invariant_"
+             << (nv ? "nv" : "iv") << "(" << svs[i] << ")";
+    }
+    code << ") {\n";
+    for (size_t i = 0; i < svs.size(); ++i) {
+        code << (nv ? "NV " : "IV ") << invariants.find(used[i])->second
+             << " = " << (nv ? "SvNVX(" : "SvIVX(") << svs[i] << ");\n";
+    }
+    code << hoisted << "}\nelse {\n";
+    if (!compile_loop_code(aTHX_ code, enter))
+        return false;
+    code << "}\n";
+
+    return true;
+}
+
+// try to compile a whole loop into a fragment
+//
+// returns the OP_LEAVELOOP on success
+OP *
+compile_whole_loop(pTHX_ const COP *cop, OP *enter, OP *prev) {
+    OP *leave = cLOOPx(enter)->op_lastop;
+    CodeFragment code{aTHX_ cop, leave->op_next};
+    if (!compile_loop(aTHX_ code, enter)) {
+        logln(CCDebugFlags::Failures, "could not compile loop {} at {} line {}",
+              OpPtr{enter}, CopFILE(cop), CopLINE(cop));
+        return nullptr;
+    }
+
+    Stack stack;
+    code_finalize(aTHX_ code, stack, enter, leave, prev);
+    return leave;
+}
+
+// find the COP for the statement containing a loop
+const COP *
+loop_cop(OP *leave) {
+    OP *parent = op_parent(leave);
+    if (!parent || !(parent->op_flags & OPf_KIDS))
+        return nullptr;
+    OP *prev = nullptr;
+    for (OP *kid = cLISTOPx(parent)->op_first; kid && kid != leave;
+         kid = OpSIBLING(kid))
+        prev = kid;
+    // the nextstate may have been nulled at the start of a block
+    if (prev && (prev->op_type == OP_NEXTSTATE ||
+                 (prev->op_type == OP_NULL && prev->op_targ == OP_NEXTSTATE)))
+        return reinterpret_cast<const COP *>(prev);
+    return nullptr;
+}
+
+// what we decided about a loop, keyed by its OP_LEAVELOOP
+struct LoopDecision {
+    bool compilable;
+    // op chains within the loop we didn't scan, waiting on the
+    // whole loop compile
+    std::vector<OP *> deferred;
+};
+
+// only valid for the duration of the outermost my_rpeepp() call
+my_map<const OP *, LoopDecision> loop_decisions;
+
+// is o part of a loop we expect to compile as a whole?
+//
+// perl's peephole optimizer calls us for loop bodies before we see
+// the loop itself, so this prevents generating fragments for the
+// body which would never be called.
+//
+// returns the OP_LEAVELOOP of the loop
+OP *
+in_compilable_loop(pTHX_ OP *o) {
+    for (OP *p = op_parent(o); p; p = op_parent(p)) {
+        if (p->op_type != OP_LEAVELOOP)
+            continue;
+        auto found = loop_decisions.find(p);
+        if (found == loop_decisions.end()) {
+            // trial compile the loop once
+            OP *enter = cBINOPx(p)->op_first;
+            const COP *cop = loop_cop(p);
+            bool compilable = false;
+            if (enter->op_type == OP_ENTERLOOP && cop &&
+                cop_bool_config(aTHX_ cop, "Faster::Maths::CC/faster")) {
+                CodeFragment code{aTHX_ cop, nullptr, true};
+                compilable = compile_loop(aTHX_ code, enter);
+            }
+            found = loop_decisions.emplace(p, LoopDecision{compilable, {}})
+                        .first;
+        }
+        if (found->second.compilable)
+            return p;
+    }
+    return nullptr;
+}
+
+void rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled);
+
+// we're done with the loop ending at leave, if it wasn't compiled
+// as a whole scan the op chains we skipped within it
+void
+finish_loop(pTHX_ OP *leave, bool compiled) {
+    if (compiled) {
+        // including those in loops nested within it
+        for (auto &[loop, decision] : loop_decisions) {
+            if (op_within(const_cast<OP *>(loop), leave))
+                decision.deferred.clear();
+        }
+        return;
+    }
+    auto found = loop_decisions.find(leave);
+    if (found == loop_decisions.end())
+        return;
+    auto deferred = std::move(found->second.deferred);
+    found->second.deferred.clear();
+    found->second.compilable = false;
+    for (OP *o : deferred)
+        rpeep_for_callcompiled(aTHX_ o, nullptr, false);
+}
+
 void
 rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
     bool enabled = init_enabled;
@@ -881,6 +4641,10 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
 
     size_t depth = 0;
     int count = 0;
+    // calls we're compiling directly
+    int open_calls = 0;
+    // list assignments we're compiling
+    int open_assigns = 0;
     OP *first = o;
     OP *firstprev = oprev;
     // OP *oprev = nullptr;
@@ -889,6 +4653,14 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
 
     while (o && o != slowo) {
         debugln("Outer op {}", OpPtr(o));
+        // perl's peephole optimizer can call us for a nested op chain
+        // that continues into ops it hasn't reached yet, and may
+        // still rewrite, such as padav/const/aelem into aelemfast_lex.
+        // Leave those for when we're called for the outer chain.
+        if (!o->op_opt) {
+            debugln("Trace: stopping at unoptimized op {}", OpPtr(o));
+            break;
+        }
         if (o->op_type == OP_NEXTSTATE) {
             SV *sv = cop_hints_fetch_pvs(cCOPo, "Faster::Maths::CC/faster", 0);
             enabled = sv && sv != &PL_sv_placeholder && SvTRUE(sv);
@@ -906,6 +4678,8 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
             first = nullptr; // o->op_next;
             count = 0;
             depth = 0;
+            open_calls = 0;
+            open_assigns = 0;
             debugln("nextstate {} file {} line {} enabled {}", OpPtr(o),
                     CopFILE(cCOPo), CopLINE(cCOPo), enabled);
         }
@@ -930,23 +4704,136 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
                 }
                 break;
 
-            case OP_CONST:
             case OP_PADSV:
+                if (!is_simple_padsv(o)) {
+                    // "my $x" isn't something we can compile
+                    if (first && oprev && count > 1) {
+                        CodeFragment code{aTHX_ last_cop, o};
+                        compile_code(aTHX_ code, first, oprev, firstprev);
+                    }
+                    first = nullptr;
+                    count = 0;
+                    break;
+                }
+                ++depth;
+                break;
+
+            case OP_CONST:
                 ++depth;
                 break;
 
+            case OP_SASSIGN:
+#if PERL_VERSION_GE(5, 38, 0)
+            case OP_PADSV_STORE:
+#endif
+                // the lvalue of an OP_SASSIGN must be in the fragment
+                if (first != o && is_simple_assign(o)) {
+                    --depth;
+                    ++count;
+                    break;
+                }
+                if (first && oprev && count > 1) {
+                    CodeFragment code{aTHX_ last_cop, o};
+                    compile_code(aTHX_ code, first, oprev, firstprev);
+                }
+                first = nullptr;
+                count = 0;
+                break;
+
+            case OP_ENTERLOOP:
+                if (first && oprev && count > 1) {
+                    // finish the expression before the loop, we
+                    // can't compile the loop too since the fragment
+                    // would skip to the original loop
+                    debugln("Trace: calling code gen (before loop)");
+
+                    CodeFragment code{aTHX_ last_cop, o};
+                    compile_code(aTHX_ code, first, oprev, firstprev);
+                } else if (oprev &&
+                           (oprev->op_next == o ||
+                            (oprev->op_type == OP_AND &&
+                             cLOGOPx(oprev)->op_other == o))) {
+                    if (OP *leave =
+                            compile_whole_loop(aTHX_ last_cop, o, oprev)) {
+                        // continue after the loop
+                        debugln("Trace: compiled loop {}", OpPtr{o});
+                        o = leave;
+                    }
+                }
+                if (o->op_type == OP_LEAVELOOP)
+                    finish_loop(aTHX_ o, true);
+                else
+                    finish_loop(aTHX_ cLOOPo->op_lastop, false);
+                first = nullptr;
+                count = 0;
+                depth = 0;
+                break;
+
             case OP_ADD:
             case OP_SUBTRACT:
             case OP_MULTIPLY:
             case OP_DIVIDE:
+            case OP_MODULO:
+            case OP_POW:
+            case OP_I_ADD:
+            case OP_I_SUBTRACT:
+            case OP_I_MULTIPLY:
+            case OP_I_DIVIDE:
+            case OP_I_MODULO:
+            case OP_ATAN2:
+            case OP_LT:
+            case OP_GT:
+            case OP_LE:
+            case OP_GE:
+            case OP_EQ:
+            case OP_NE:
+            case OP_NCMP:
+            case OP_I_LT:
+            case OP_I_GT:
+            case OP_I_LE:
+            case OP_I_GE:
+            case OP_I_EQ:
+            case OP_I_NE:
+            case OP_I_NCMP:
                 --depth;
                 ++count;
                 break;
             case OP_NEGATE:
+            case OP_I_NEGATE:
+            case OP_PREINC:
+            case OP_I_PREINC:
+            case OP_PREDEC:
+            case OP_I_PREDEC:
+            case OP_POSTINC:
+            case OP_I_POSTINC:
+            case OP_POSTDEC:
+            case OP_I_POSTDEC:
+            case OP_ABS:
+            case OP_INT:
+            case OP_SIN:
+            case OP_COS:
+            case OP_EXP:
+            case OP_LOG:
+            case OP_SQRT:
                 ++count;
                 break;
 
             case OP_AND:
+            case OP_OR:
+            case OP_DOR:
+            case OP_COND_EXPR:
+            case OP_ANDASSIGN:
+            case OP_ORASSIGN:
+            case OP_DORASSIGN:
+                if (OP *last = accept_logop(aTHX_ o, first, last_cop)) {
+                    // the test and at least one branch, continue
+                    // where the paths meet
+                    count += 2;
+                    o = last;
+                    break;
+                }
+                // otherwise perl runs the conditional, and a fragment
+                // may start on its false path
                 if (first && oprev && count > 1) {
                     debugln("Trace: calling code gen (logop)");
 
@@ -957,21 +4844,64 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
                 first = o->op_next;
                 count = 0;
                 depth = 0;
-                if (cLOGOPo->op_other &&
+                if (o->op_type == OP_AND && cLOGOPo->op_other &&
                     cLOGOPo->op_other->op_type != OP_NEXTSTATE)
                     rpeep_for_callcompiled(aTHX_ cLOGOPo->op_other, o, enabled);
                 break;
 
-            case OP_OR:
-            case OP_DOR:
+            case OP_MULTIDEREF:
+                if (can_compile_multideref(o)) {
+                    ++count;
+                    break;
+                }
+                [[fallthrough]];
+
+            case OP_AELEMFAST:
+            case OP_AELEMFAST_LEX:
+            case OP_AELEM:
+            case OP_HELEM:
+                if (o->op_type != OP_MULTIDEREF && is_rvalue_elem(o)) {
+                    if (o->op_type == OP_AELEM || o->op_type == OP_HELEM) {
+                        --depth;
+                        ++count;
+                    } else {
+                        ++depth;
+                    }
+                    break;
+                }
+                [[fallthrough]];
+
+            case OP_PADAV:
+            case OP_PADHV:
+            case OP_RV2AV:
+            case OP_RV2HV:
+            case OP_PUSHMARK:
+            case OP_PADRANGE:
+            case OP_GV:
+            case OP_ENTERSUB:
+            case OP_AASSIGN:
+                // the array or hash for an element fetch
+                if (is_aggregate_ref_op(o)) {
+                    if (o->op_type != OP_RV2AV && o->op_type != OP_RV2HV)
+                        ++depth;
+                    break;
+                }
+                if (accept_list_assign_op(aTHX_ o, last_cop, open_assigns)) {
+                    if (o->op_type == OP_AASSIGN)
+                        ++count;
+                    break;
+                }
+                if (accept_call_op(aTHX_ o, last_cop, open_calls)) {
+                    if (o->op_type == OP_ENTERSUB)
+                        ++count;
+                    break;
+                }
+                [[fallthrough]];
+
 #if PERL_VERSION_GE(5, 32, 0)
             case OP_CMPCHAIN_AND:
 #endif
-            case OP_COND_EXPR:
             case OP_MAPWHILE:
-            case OP_ANDASSIGN:
-            case OP_ORASSIGN:
-            case OP_DORASSIGN:
             case OP_RANGE:
             case OP_ONCE:
 #if PERL_VERSION_GE(5, 26, 0)
@@ -987,7 +4917,9 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
                 // if(cLOGOPo->op_other && cLOGOPo->op_other->op_type !=
                 // OP_NEXTSTATE)
                 //  rpeep_for_callcompiled(aTHX_ cLOGOPo->op_other, o, enabled);
-                break;
+                //
+                // the left hand side still needs to be finished
+                [[fallthrough]];
 
             default:
                 debugln("Trace: unrecognized op {}", OpPtr(o));
@@ -1020,17 +4952,41 @@ rpeep_for_callcompiled(pTHX_ OP *o, OP *oprev, bool init_enabled) {
 
 void (*next_rpeepp)(pTHX_ OP *o);
 
+// nesting of my_rpeepp() calls, perl calls it for nested op chains
+// from within the call for the outer chain
+int rpeep_depth = 0;
+
 void
 my_rpeepp(pTHX_ OP *o) {
     if (!o)
         return;
 
+    // left over if perl croaked during an earlier call
+    if (!rpeep_depth)
+        loop_decisions.clear();
+
+    ENTER;
+    SAVEINT(rpeep_depth);
+    ++rpeep_depth;
     (*next_rpeepp)(aTHX_ o);
+    LEAVE;
 
-    if (!fragments) {
-        if (DebugFlags(CCDebugFlags::OpDump))
-            op_dump(o);
+    if (DebugFlags(CCDebugFlags::OpDump))
+        op_dump(o);
+    if (OP *leave = in_compilable_loop(aTHX_ o))
+        loop_decisions[leave].deferred.push_back(o);
+    else
         rpeep_for_callcompiled(aTHX_ o, nullptr, false);
+
+    if (!rpeep_depth) {
+        // scan within any loops we skipped parts of but never reached
+        while (!loop_decisions.empty()) {
+            auto first = loop_decisions.begin();
+            auto deferred = std::move(first->second.deferred);
+            loop_decisions.erase(first);
+            for (OP *d : deferred)
+                rpeep_for_callcompiled(aTHX_ d, nullptr, false);
+        }
     }
 }
 
@@ -1044,14 +5000,17 @@ my_xop_dump(pTHX_ const OP *o, struct Perl_OpDumpContext *ctx) {
 }
 #endif
 
-// called via PL_modglobal from the generated module to register
-// the code fragment lookup table
+// called via PL_modglobal from each generated module to register
+// its code fragments, starting from fragment index base
 void
-register_fragments(pTHX_ const fragment_handler *frags, size_t frag_count) {
-    fragment_count = frag_count;
-    fragments = frags;
+register_fragments(pTHX_ const fragment_handler *frags, size_t frag_count,
+                   size_t base) {
+    if (fragments.size() < base + frag_count)
+        fragments.resize(base + frag_count);
+    std::copy(frags, frags + frag_count, fragments.begin() + base);
     if (DebugFlags(CCDebugFlags::Register))
-        std::cerr << "Registered " << frag_count << " handlers\n";
+        std::cerr << "Registered " << frag_count << " handlers from " << base
+                  << "\n";
 }
 
 } // anonymous namespace
@@ -1061,6 +5020,9 @@ namespace fmcc {
 void
 boot(pTHX) {
     init_debug_flags();
+    init_spec_passes(aTHX);
+    const char *profile = getenv("PERL_FMC_PROFILE");
+    profiling = profile && *profile;
     next_rpeepp = PL_rpeepp;
     PL_rpeepp = &my_rpeepp;
 
@@ -1077,4 +5039,65 @@ boot(pTHX) {
     // FIXME: hook PL_opfreehook to clean up aux items
 }
 
+void
+set_background_pending(bool pending) {
+    background_pending = pending;
+}
+
+// add the kinds of values counted while profiling to
+// %Faster::Maths::CC::profile, replacing any entry for a fragment
+// that isn't the same code
+void
+profile_update(pTHX) {
+    HV *profile = get_hv("Faster::Maths::CC::profile", GV_ADD);
+    for (size_t index = 0; index < profile_fragments.size(); ++index) {
+        auto &frag = profile_fragments[index];
+        if (frag.inputs.empty())
+            continue;
+        auto key = std::to_string(index);
+        SV **svp = hv_fetch(profile, key.c_str(), key.size(), 1);
+        HV *entry = nullptr;
+        AV *inputs = nullptr;
+        if (SvROK(*svp) && SvTYPE(SvRV(*svp)) == SVt_PVHV) {
+            entry = (HV *)SvRV(*svp);
+            SV **file = hv_fetchs(entry, "file", 0);
+            SV **line = hv_fetchs(entry, "line", 0);
+            SV **ins = hv_fetchs(entry, "inputs", 0);
+            if (file && line && ins &&
+                strEQ(SvPV_nolen(*file), frag.file.c_str()) &&
+                SvUV(*line) == frag.line && SvROK(*ins) &&
+                SvTYPE(SvRV(*ins)) == SVt_PVAV &&
+                av_count((AV *)SvRV(*ins)) == frag.inputs.size())
+                inputs = (AV *)SvRV(*ins);
+        }
+        if (!inputs) {
+            entry = newHV();
+            sv_setrv_noinc(*svp, (SV *)entry);
+            (void)hv_stores(entry, "file",
+                            newSVpvn(frag.file.data(), frag.file.size()));
+            (void)hv_stores(entry, "line", newSVuv(frag.line));
+            inputs = newAV();
+            (void)hv_stores(entry, "inputs", newRV_noinc((SV *)inputs));
+            for (size_t i = 0; i < frag.inputs.size(); ++i)
+                av_push(inputs, newRV_noinc((SV *)newHV()));
+        }
+        for (size_t i = 0; i < frag.inputs.size(); ++i) {
+            SV **input = av_fetch(inputs, i, 1);
+            if (!SvROK(*input) || SvTYPE(SvRV(*input)) != SVt_PVHV)
+                sv_setrv_noinc(*input, (SV *)newHV());
+            HV *counts = (HV *)SvRV(*input);
+            for (size_t kind = 0; kind < std::size(profile_kind_names);
+                 ++kind) {
+                UV count = frag.inputs[i].counts[kind];
+                if (!count)
+                    continue;
+                const char *name = profile_kind_names[kind];
+                SV **sv = hv_fetch(counts, name, strlen(name), 1);
+                sv_setuv(*sv, (SvOK(*sv) ? SvUV(*sv) : 0) + count);
+                frag.inputs[i].counts[kind] = 0;
+            }
+        }
+    }
+}
+
 } // namespace fmcc
@@ -1,4 +1,8 @@
 namespace fmcc {
   void
     boot(pTHX);
+  void
+    set_background_pending(bool pending);
+  void
+    profile_update(pTHX);
 }
@@ -12,6 +12,10 @@ package Faster::Maths::CC 0.001;
 use v5.42;
 use warnings;
 use File::Temp;
+use File::Path ();
+use Fcntl qw(:flock);
+use Digest::SHA ();
+use Config;
 use blib ();
 use Devel::PPPort ();
 use File::Spec ();
@@ -66,17 +70,25 @@ my sub run {
   return system $cmd;
 }
 
-sub make_xs {
-  my ($module) = @_;
+# generate the C code for the fragments in @collection from index
+# $first on, along with the table of handlers the module registers
+#
+# Every leaf sub function in @leaves is included, since fragments in
+# any build might call them.
+my sub make_fragments {
+  my ($first) = @_;
 
-  our @collection;
+  our (@collection, @leaves);
+  $first //= 0;
+  my @entries = @collection[$first .. $#collection];
 
   my $header_name =
     File::ShareDir::dist_file("Faster-Maths-CC", "header.c");
   open my $fh, "<", $header_name or die "Cannot open $header_name: $!";
   my $code = do { local $/; <$fh> };
   close $fh;
-  for my $entry (@collection) {
+  $code .= join "", @leaves;
+  for my $entry (@entries) {
     $code .= "// $entry->[3]:$entry->[2]\n";
     $code .= $entry->[0];
   }
@@ -85,31 +97,69 @@ sub make_xs {
 static fragment_handler
 handlers[] = {
 EOS
-  $code .= join(",\n  ", map $_->[1], @collection);
+  $code .= join(",\n  ", map $_->[1], @entries);
   $code .= "\n};\n\n";
-  my $count = @collection;
+  my $count = @entries;
   $code .= <<"EOS";
 
 static const size_t handler_count = $count;
+static const size_t handler_base = $first;
 
 typedef void
 (*register_fragments_p)(pTHX_ const fragment_handler *frags,
-                   size_t frag_count);
+                   size_t frag_count, size_t base);
 
-MODULE = $module
+EOS
 
-# for all our XSUBs
-PROTOTYPES: DISABLE
+  return $code;
+}
 
-BOOT:
+# code to register the handlers with us when the module is loaded
+my $register_code = <<'EOS';
   SV **svp = hv_fetchs(PL_modglobal, "Faster::Maths::CC::register", 0);
   if (!svp)
     Perl_croak(aTHX_ "Could not find FMC registration function");
   register_fragments_p reg = (register_fragments_p)SvIV(*svp);
-  reg(aTHX_ handlers, handler_count);
+  reg(aTHX_ handlers, handler_count, handler_base);
 EOS
 
-  return $code;
+# generate the XS source for the fragments in @collection from
+# index $first on
+sub make_xs {
+  my ($module, $first) = @_;
+
+  return make_fragments($first) . <<"EOS" . $register_code;
+MODULE = $module
+
+# for all our XSUBs
+PROTOTYPES: DISABLE
+
+BOOT:
+EOS
+}
+
+my sub boot_name {
+  my ($module) = @_;
+
+  return "boot_" . $module =~ s/\W/_/gr;
+}
+
+# generate plain C source for the fragments in @collection from index
+# $first on, with the bootstrap function xsubpp would generate from
+# make_xs()
+sub make_c {
+  my ($module, $first) = @_;
+
+  my $boot = boot_name($module);
+  return make_fragments($first) . <<"EOS" . $register_code . <<'EOS';
+XS_EXTERNAL($boot);
+XS_EXTERNAL($boot) {
+  dXSARGS;
+  PERL_UNUSED_VAR(items);
+EOS
+  XSRETURN_YES;
+}
+EOS
 }
 
 my sub make_mfpl {
@@ -141,31 +191,65 @@ EOS
   
 }
 
-my $build_dir;
+# temp build directories, kept until exit
+my @build_dirs;
+
+# entries in @collection already included in a build
+my $built_count = 0;
+
+# number of modules built after CHECK time
+my $late_builds = 0;
+
+# where cached builds of the generated module live, or undef if
+# caching is disabled
+my sub cache_dir {
+  my $dir = $ENV{PERL_FMC_CACHE};
+  defined $dir
+    and return length $dir ? $dir : undef;
+  my $base = $ENV{XDG_CACHE_HOME};
+  unless ($base) {
+    $ENV{HOME}
+      or return;
+    $base = "$ENV{HOME}/.cache";
+  }
+  return "$base/faster-maths-cc";
+}
 
-CHECK {
-  my $module = "Faster::Maths::CC::Compiled";
-  (my $base = $module) =~ s/.*:://;
+# the generated code only identifies a build if everything else that
+# can change the object code is included too
+my sub cache_key {
+  my ($backend, $code) = @_;
 
-  my $code = make_xs($module);
-  my $cleanup = !$ENV{PERL_FMC_KEEP};
-  $build_dir = File::Temp->newdir(CLEANUP => $cleanup);
-  print STDERR "Build $build_dir\n" unless $cleanup;
-  my $mfpl = "$build_dir/Makefile.PL";
-  my $pm = "$build_dir/$base.pm";
-  my $xs = "$build_dir/$base.xs";
-  my $ppport = "$build_dir/ppport.h";
+  my $sha = Digest::SHA->new(256);
+  $sha->add(join "\0", __PACKAGE__->VERSION, $], $^X, $backend->{name},
+            @Config{qw(archname cc ccflags optimize cccdlflags lddlflags
+                       dlext)},
+            $ENV{PERL_FMC_MAKEFILEPL} // "", "");
+  $sha->add($code);
+
+  return $sha->hexdigest;
+}
+
+# generate and build the XS module in $dir, which must exist
+my sub build_make {
+  my ($dir, $module, $code) = @_;
+
+  (my $base = $module) =~ s/.*:://;
+  my $mfpl = "$dir/Makefile.PL";
+  my $pm = "$dir/$base.pm";
+  my $xs = "$dir/$base.xs";
+  my $ppport = "$dir/ppport.h";
 
   # generate the dist files
-  save_file($xs, make_xs($module));
+  save_file($xs, $code);
   save_file($mfpl, make_mfpl($module, $base));
   save_file($pm, make_pm($module));
   Devel::PPPort::WriteFile($ppport);
 
   # build it
   my $olddir = Cwd::getcwd();
-  chdir $build_dir
-    or die "Cannot chdir $build_dir: $!\n";
+  chdir $dir
+    or die "Cannot chdir $dir: $!\n";
   my $debug_b = DebugFlags("b");
   my $ok = eval {
     print STDERR "Makefile.PL:\n"
@@ -181,12 +265,352 @@ CHECK {
     };
   chdir $olddir
     or die "Cannot return to $olddir: $!\n";
-  $@ and die "Failed build in $build_dir: $@\n";
+  $@ and die "Failed build in $dir: $@\n";
+}
+
+my sub load_make {
+  my ($module, $dir) = @_;
+
+  blib->import($dir);
+  (my $file = "$module.pm") =~ s(::)(/)g;
+  require $file;
+}
+
+my sub dl_file {
+  my ($module, $dir) = @_;
+
+  (my $base = $module) =~ s/.*:://;
+  return "$dir/$base.$Config{dlext}";
+}
+
+# build the C source in $dir with a single compiler run, using the
+# same flags MakeMaker would
+my sub build_cc {
+  my ($dir, $module, $code) = @_;
+
+  (my $base = $module) =~ s/.*:://;
+  my $c = "$dir/$base.c";
+  save_file($c, $code);
+  Devel::PPPort::WriteFile("$dir/ppport.h");
+
+  print STDERR "cc:\n"
+    if DebugFlags("b");
+  my $incdir = File::Spec->catdir($Config{archlibexp}, "CORE");
+  my $so = dl_file($module, $dir);
+  # the flags are split by the shell, the paths need quoting
+  run(join " ", $Config{cc}, $Config{ccflags}, $Config{optimize},
+      $Config{cccdlflags}, qq("-I$dir"), qq("-I$incdir"), qq("$c"),
+      "-o", qq("$so"), $Config{lddlflags})
+    and die "Failed build in $dir: Cannot run $Config{cc}\n";
+}
+
+# load the shared object directly, as XSLoader would if there was a
+# .pm to load it from
+my sub load_cc {
+  my ($module, $dir) = @_;
+
+  require DynaLoader;
+  my $file = dl_file($module, $dir);
+  my $libref = DynaLoader::dl_load_file($file, 0)
+    or die "Cannot load $file: ", DynaLoader::dl_error(), "\n";
+  my $symref = DynaLoader::dl_find_symbol($libref, boot_name($module))
+    or die "Cannot find bootstrap in $file: ", DynaLoader::dl_error(), "\n";
+  push @DynaLoader::dl_librefs, $libref;
+  push @DynaLoader::dl_modules, $module;
+  push @DynaLoader::dl_shared_objects, $file;
+  my $boot = DynaLoader::dl_install_xsub("${module}::bootstrap", $symref,
+                                         $file);
+  $boot->($module);
+  # mark it loaded, like a .pm would be
+  (my $pm = "$module.pm") =~ s(::)(/)g;
+  $INC{$pm} = $file;
+}
+
+# ways to build and load the generated code, see PERL_FMC_BACKEND
+my %backends =
+  (
+    make => { source => \&make_xs, build => \&build_make,
+              load => \&load_make },
+    cc => { source => \&make_c, build => \&build_cc, load => \&load_cc },
+  );
+$backends{$_}{name} = $_ for keys %backends;
+
+my sub backend {
+  my $name = $ENV{PERL_FMC_BACKEND} || ($^O eq "MSWin32" ? "make" : "cc");
+  my $backend = $backends{$name}
+    or die "Unknown PERL_FMC_BACKEND $name\n";
+
+  return $backend;
+}
+
+# Build into the cache, returning the directory to load the module
+# from.
+#
+# Builds are done in a temp directory under the cache directory and
+# renamed into place once complete, so a cache entry that exists is
+# always complete.  The lock only prevents many processes starting at
+# once from all doing the same build, the rename is what keeps it
+# safe.
+my sub cached_build {
+  my ($cache, $backend, $module, $code) = @_;
+
+  my $debug_b = DebugFlags("b");
+  my $entry = "$cache/" . cache_key($backend, $code);
+  if (-d $entry) {
+    print STDERR "Cache hit: $entry\n"
+      if $debug_b;
+    return $entry;
+  }
+
+  # a broken cache directory shouldn't prevent the program running
+  my $lock = "$entry.lock";
+  my $lockfh;
+  unless (eval { File::Path::make_path($cache); 1 }
+          && open($lockfh, ">>", $lock)
+          && flock($lockfh, LOCK_EX)) {
+    print STDERR "Cannot use cache $cache: ", $@ || $!, "\n"
+      if $debug_b;
+    return;
+  }
+  if (-d $entry) {
+    print STDERR "Cache hit (after lock): $entry\n"
+      if $debug_b;
+    return $entry;
+  }
+
+  my $cleanup = !$ENV{PERL_FMC_KEEP};
+  my $build_dir = File::Temp->newdir("buildXXXXXX", DIR => $cache,
+                                     CLEANUP => $cleanup);
+  push @build_dirs, $build_dir;
+  print STDERR "Build $build_dir\n" unless $cleanup;
+  $backend->{build}->("$build_dir", $module, $code);
+  if (rename "$build_dir", $entry) {
+    print STDERR "Cache store: $entry\n"
+      if $debug_b;
+  }
+  elsif (-d $entry) {
+    # someone without the lock beat us to it
+    print STDERR "Cache store lost race: $entry\n"
+      if $debug_b;
+  }
+  else {
+    print STDERR "Cache store failed ($!), using $build_dir\n"
+      if $debug_b;
+    $entry = "$build_dir";
+  }
+  # anyone still waiting on the lock sees the entry once they get it,
+  # and anyone later sees it before trying to lock
+  unlink $lock;
+  close $lockfh;
+
+  return $entry;
+}
+
+# builds running in the background, see PERL_FMC_BACKGROUND
+my @background;
+
+my sub background {
+  return $ENV{PERL_FMC_BACKGROUND} && $Config{d_fork};
+}
+
+my sub temp_build_dir {
+  my $cleanup = !$ENV{PERL_FMC_KEEP};
+  my $build_dir = File::Temp->newdir(CLEANUP => $cleanup);
+  push @build_dirs, $build_dir;
+  print STDERR "Build $build_dir\n" unless $cleanup;
+  return "$build_dir";
+}
+
+# build the module, returning the directory to load it from.
+# $build_dir is used if the cache can't be, created if not supplied.
+my sub build_code {
+  my ($backend, $module, $code, $build_dir) = @_;
+
+  my $cache = cache_dir();
+  my $load_dir = $cache ? cached_build($cache, $backend, $module, $code)
+    : undef;
+  unless ($load_dir) {
+    $build_dir //= temp_build_dir();
+    $backend->{build}->($build_dir, $module, $code);
+    $load_dir = $build_dir;
+  }
+
+  return $load_dir;
+}
+
+my sub load_module {
+  my ($backend, $module, $load_dir) = @_;
 
   print STDERR "Loading:\n"
-    if $debug_b;
-  blib->import($build_dir);
-  require Faster::Maths::CC::Compiled;
+    if DebugFlags("b");
+  $backend->{load}->($module, $load_dir);
+}
+
+# fork a child to do the build, poll_background() loads the module
+# once it's done.
+#
+# Returns false if the build should be done in the foreground
+# instead, including on a cache hit since that's immediately usable.
+my sub start_background {
+  my ($backend, $module, $code) = @_;
+
+  my $cache = cache_dir();
+  return if $cache && -d "$cache/" . cache_key($backend, $code);
+
+  # the parent owns the fallback build directory, the child exits
+  # without cleaning up
+  my $build_dir = temp_build_dir();
+  my $keep_dirs = @build_dirs;
+  pipe(my $rfh, my $wfh)
+    or return;
+  my $pid = fork;
+  defined $pid
+    or return;
+  unless ($pid) {
+    close $rfh;
+    local $SIG{__DIE__};
+    my $load_dir = eval { build_code($backend, $module, $code, $build_dir) };
+    print $wfh $load_dir ? "ok $load_dir\n" : $@;
+    close $wfh;
+    # clean up any temp directory the failed build left in the cache
+    splice @build_dirs, $keep_dirs unless $load_dir;
+    require POSIX;
+    POSIX::_exit($load_dir ? 0 : 1);
+  }
+  close $wfh;
+  $rfh->blocking(0);
+  print STDERR "Background build $module in $pid\n"
+    if DebugFlags("b");
+  push @background, { backend => $backend, module => $module, pid => $pid,
+                      fh => $rfh, output => "" };
+  _set_background_pending(1);
+
+  return 1;
+}
+
+# build and load a module for the fragments in @collection not yet
+# built
+my sub build_and_load {
+  my ($module) = @_;
+
+  our @collection;
+  my $first = $built_count;
+  $built_count = @collection;
+  my $backend = backend();
+  my $code = $backend->{source}->($module, $first);
+  background() && start_background($backend, $module, $code)
+    and return;
+  load_module($backend, $module, build_code($backend, $module, $code));
+}
+
+CHECK {
+  build_and_load("Faster::Maths::CC::Compiled");
+}
+
+# called from the callcompiled OP when it finds a fragment generated
+# after CHECK time, eg. from a runtime require or string eval
+sub build_late {
+  our @collection;
+  $built_count < @collection
+    or return;
+
+  build_and_load("Faster::Maths::CC::Compiled" . ++$late_builds);
+}
+
+# called from the callcompiled OP every so often while background
+# builds are running, loads any that have finished
+sub poll_background {
+  my @done;
+  for my $build (@background) {
+    # the child closes the pipe once it's done
+    my $got = sysread($build->{fh}, $build->{output}, 4096,
+                      length $build->{output});
+    $got || !defined $got && $!{EAGAIN}
+      or push @done, $build;
+  }
+  @done
+    or return;
+
+  my %done = map { $_ => 1 } @done;
+  @background = grep !$done{$_}, @background;
+  _set_background_pending(0) unless @background;
+  for my $build (@done) {
+    close $build->{fh};
+    waitpid($build->{pid}, 0);
+    my $module = $build->{module};
+    if ($build->{output} =~ /^ok (.*)\n\z/) {
+      print STDERR "Background build $module done\n"
+        if DebugFlags("b");
+      eval { load_module($build->{backend}, $module, $1); 1 }
+        or warn "Faster::Maths::CC: cannot load $module: $@";
+    }
+    else {
+      warn "Faster::Maths::CC: background build of $module failed: ",
+        $build->{output} || "no output\n";
+    }
+  }
+}
+
+# type profiles, see PERL_FMC_PROFILE
+#
+# Keyed by fragment index, each entry is:
+#
+#   { file => $file, line => $line, inputs => [ { iv => $count, ... } ] }
+#
+# where each input has the number of times it was seen as each kind of
+# value.  Entries are only used for the same code, see docc.cpp.
+our %profile;
+
+my $profile_file = $ENV{PERL_FMC_PROFILE};
+
+# only the process that loaded the profile writes it, not any children
+my $profile_pid = $$;
+
+# load the profile, one line per fragment, input and kind of value
+my sub load_profile {
+  my ($name) = @_;
+
+  open my $fh, "<", $name
+    or return; # no profile yet
+  while (my $row = <$fh>) {
+    chomp $row;
+    my ($index, $line, $input, $kind, $count, $file) = split /\t/, $row, 6;
+    defined $file && $count =~ /^[0-9]+\z/
+      or next;
+    my $entry = $profile{$index} //=
+      { file => $file, line => $line, inputs => [] };
+    $entry->{inputs}[$input]{$kind} += $count;
+  }
+  close $fh;
+}
+
+# write the profile, including the counts from this run
+my sub save_profile {
+  my ($name) = @_;
+
+  _profile_update();
+  my $out = "";
+  for my $index (sort { $a <=> $b } keys %profile) {
+    my $entry = $profile{$index};
+    my $inputs = $entry->{inputs};
+    for my $input (0 .. $#$inputs) {
+      my $counts = $inputs->[$input];
+      for my $kind (sort keys %$counts) {
+        $out .= join("\t", $index, $entry->{line}, $input, $kind,
+                     $counts->{$kind}, $entry->{file}) . "\n";
+      }
+    }
+  }
+  save_file($name, $out);
+}
+
+load_profile($profile_file) if $profile_file;
+
+END {
+  if ($profile_file && $$ == $profile_pid) {
+    eval { save_profile($profile_file); 1 }
+      or warn "Faster::Maths::CC: cannot save profile: $@";
+  }
 }
 
 =head1 NAME
@@ -239,6 +663,88 @@ point, similar to L<Faster::Maths>.
 Note that unary negation with "+float" will always do numeric
 negation, it does not support string negation.
 
+The C<use integer> versions of the operators are also supported, and
+with overloading disabled work directly with C integers, "+float" has
+no effect on them.
+
+The increment and decrement operators C<++> and C<-->, prefix and
+postfix, are compiled with a fast path for plain integers, falling
+back to perl's own code for strings, floating point values, overflow
+and overloading.  The assignment forms of the arithmetic operators,
+such as C<+=> and C<*=>, are also compiled.
+
+The numeric builtins C<abs>, C<int>, C<sqrt>, C<sin>, C<cos>, C<exp>,
+C<log> and C<atan2> are compiled too.  Except for C<abs> and C<int>
+these always produce a floating point result, so with overloading
+disabled their results are kept as C C<NV>s even without "+float".
+
+Without "+float", values whose type is certain are also kept as C
+values where perl's result would be the same.  Perl only does
+integer arithmetic when both operands are integers, so C<+>, C<->
+and C<*> with a constant that isn't an integer, such as C<0.5>, are
+done in floating point, as is dividing by such a constant.  Negating
+a floating point result, and comparing two floating point results,
+two integers, or a floating point result with a small integer
+constant or with a constant that isn't an integer, are done in C
+too.  Where an operand is a variable this needs overloading
+disabled, and the assignment forms, like C<+=>, are left to perl.
+
+Calls to the XSUBs C<POSIX::floor>, C<POSIX::ceil>, C<POSIX::fmod>
+and C<List::Util>'s C<min>, C<max> and C<sum>, whether called by
+their full names or imported, are replaced with C code that does the
+same work, when the arguments are a fixed list of scalars.  The sub
+called is found when the calling code is compiled, so redefining one
+of these subs afterwards isn't noticed.  C<POSIX::pow> is written in
+perl, use C<**> instead.
+
+A perl sub whose body is a single "+float" expression, with overloading
+disabled, taking a fixed list of scalar parameters (from a signature
+without defaults or slurpy parameters, or C<my (...) = @_>) and
+returning a number or comparison result, is compiled to a C function.
+Calls to that sub with the right number of arguments from other
+"+float", C<no overloading> code then call the C function directly,
+passing the arguments as C<NV>s, without entering the sub.  As with
+the XSUBs above the sub is found when the caller is compiled, so it
+must be defined before the call, and redefining it later isn't
+noticed.  The sub itself is left as a perl sub, so other callers are
+unaffected.
+
+Array element fetches, such as C<$x[0]>, C<$_[1]>, C<$x[$i + 1]> and
+C<< $ref->[$i - 1] >>, are compiled when the element is only read.
+Elements within the bounds of a plain array are read directly, other
+arrays and indexes fall back to perl's own array functions, so tied
+arrays, negative indexes and overloaded C<@{}> still work.
+
+Hash element fetches with constant keys, such as C<< $p->{x} >>,
+C<$h{x}> and C<< $p->{a}{b} >>, are also compiled when only read, as
+are other keys for a single hash element.  The hash of a constant key
+is computed when the code is generated, so each fetch only looks the
+key up.  As with perl, fetching through an undefined reference
+vivifies it.
+
+Assignments to lexical scalars, such as C<$x = $h{a}> and C<my $x =
+$a * $b>, store the value directly into the variable.  A C<my>
+variable is still cleared when its scope is left, so closures see a
+new variable each time.  Loops containing C<my> aren't compiled as a
+whole, but their statements are still compiled.
+
+List assignments to lexical scalars, such as C<< ($x, $y) = ($y, $x +
+$y) >>, are compiled too, when the number of values matches the number
+of variables and the result isn't used.  Each value is fetched before
+any variable is changed, so swapping variables works as it does in
+perl.
+
+The conditional operators C<&&>, C<||>, C<//>, their assignment forms
+such as C<||=>, and C<?:> are compiled into C C<if> statements, with
+both branches in the same fragment as the surrounding expression.
+Within a whole compiled loop, statements like C<< --$count or return
+undef; >> and C<< $x > 10 and last; >> are compiled too.
+
+Chains of element fetches with simple indexes, which perl merges into
+a single op, such as C<< $r->[$i]{$k}[0] >> and C<$x[$i]>, are
+compiled whether they mix arrays and hashes, use constant keys or
+index by plain variables.
+
 For the julia set test case from Faster::Maths this produces
 performance improvements like:
 
@@ -257,14 +763,65 @@ some random variation.
 
 During compilation the peep hook is used to trace the C<op_next> chain
 looking for chains of three or more OPs that are supported by the code
-generation.  Logical OP C<op_other> ops start a new sequence of OPs.
+generation.  A conditional OP (C<&&>, C<||>, C<//>, their assignment
+forms, and C<?:>) doesn't end the sequence when the OPs reached
+through both its C<op_next> and C<op_other> are supported: both
+branches are compiled into a C C<if> in the same fragment, and the
+fragment is inserted under the OP containing both its first and last
+OPs.  Where the conditional leaves a result, the value from each
+branch is stored into a single C variable by C<merge_results()>,
+which stays a C number if both branches produce the same kind of
+number, and is an SV otherwise.  If either branch can't be compiled
+the sequence ends at the conditional, and its C<op_other> branch
+starts a new sequence.
 
 Once a sequence of compatible OPs are found C code is generated for
 them, except that instead of pushing and popping values from the perl
-value stack, local variables are used instead.  The code generated
-currently always works with PADTMPs for results, so there's no new SVs
-created beyond those that already exist, avoiding the possibility of
-leaks.
+value stack, local variables are used instead.  Numeric results are
+kept in C C<NV>, C<IV> or C<bool> variables where possible, and only
+stored into an SV where one is needed, such as for a store to a
+variable or a value left on the stack.  That SV is the OP's PADTMP
+target when it has one.  Otherwise C<box_raw()> creates a new mortal
+SV, as it does for values merged from the branches of a conditional
+or constants written as C literals, when they're needed as an SV.
+These mortals are released by the C<FREETMPS> at the start of the
+next statement, so nothing leaks.
+
+Loops (C<while>, C<until>, C<for (;;)> and bare blocks) where every OP
+in the condition and body is supported, are compiled as a whole into
+a C loop, so the loop runs in a single call to the generated code.
+C<next>, C<last> and C<redo> without a label, and C<return> of
+supported expressions are handled within the generated loop.
+
+With overloading disabled, a loop without nested loops is generated
+a second time, reading the numbers in the variables it uses but
+never stores to once before it starts, instead of on each use.  That
+version is only run if each of those variables holds a plain floating
+point value ("+float") or integer (otherwise), has no magic, and isn't
+referred to by anything but the sub itself, such as a closure, so
+nothing the loop does can change it.
+
+Without "+float", a fragment made only of arithmetic, numeric
+comparisons and assignments to lexical scalars is also generated a
+second time, working directly on C integers.  On entry the fragment
+checks that every value it reads is a plain integer, with no string
+or floating point value and no magic, and that every variable it
+stores to has no magic, and only then runs the integer version.
+Otherwise, or if the integer version would overflow, where perl
+would produce a floating point result, the general code is run
+instead, so the results are the same either way.  An overflow can
+only be handled that way before the integer version has stored
+anything, so a fragment that stores to a variable before such a
+check is left with only the general code.
+
+Arithmetic repeated on the same values, as in C<$x * $y + $x * $y>, is
+only done once where those values are held in C variables: in the
+integer version of a fragment, where each variable is also only read
+once, and for the intermediate results and constants of code without
+overloading that works on C numbers.  Values are still read from
+variables each time they're used in the general code, since reading
+a tied variable or one holding a string can run perl code that
+changes other variables.
 
 When code is generated a C<callcompiled> OP is inserted before the
 original OPs, this will call the generated code fragment once the XS
@@ -275,6 +832,29 @@ We don't want to compile each generated C code fragment separately, so
 they're accumulated until C<CHECK> time when an XS module with the
 generated code is created, compiled and loaded.
 
+By default the generated code is compiled to a shared object with a
+single run of the C compiler, using the compiler and flags perl was
+built with, and loaded directly with L<DynaLoader>.  See
+L</PERL_FMC_BACKEND> to build a full XS module with F<Makefile.PL>
+and C<make> instead.
+
+Code compiled after C<CHECK> time, such as modules loaded with
+C<require> or string C<eval>, is collected the same way.  The first
+time one of those fragments is run, all of the fragments collected
+since the last build are built into another XS module and loaded.
+Until then, and if that build fails, the original OPs are used.
+
+The built XS module is cached, keyed on a hash of the generated code,
+F<share/header.c>, the perl configuration and build options, so
+starting the same program again just loads the previously built
+module.  See L</PERL_FMC_CACHE>.
+
+With L</PERL_FMC_BACKGROUND> set, a build that isn't in the cache is
+done by a child process instead, so the program starts immediately
+using the original OPs.  The C<callcompiled> OP checks every so often
+whether the build has finished and if so loads the module, after
+which the generated code is used.
+
 =head2 BUGS
 
 =over 2
@@ -294,8 +874,8 @@ doesn't handle C<PERL_RC_STACK> builds
 
 =item *
 
-only Perl code compiled before C<CHECK> time is scanned and compiled
-to C (this won't be fixed for a while, if at all)
+code compiled after C<CHECK> time is only built when it is first run,
+so the first call pays for the build.
 
 =back
 
@@ -305,29 +885,22 @@ to C (this won't be fixed for a while, if at all)
 
 =item *
 
-cache generated code - currently the code is generated and the XS
-module is created and compiled for each run.  It should be possible to
-skip the last steps when restarting the same program.
-
-=item *
-
 Support more OPs
 
 =item *
 
-support more math related ops, builtin functions, POSIX functions
+support more builtin functions, POSIX and List::Util functions
 
 =item *
 
-support more structural code, like loops, conditionals (requires a
-major re-work)
+support more structural code, like C<foreach> loops
 
 =item *
 
-compile leaf functions to directly callable code, and call that from
-calling functions.  It may be necessary to delay all code gen to
-C<CHECK> time so that functions defined after their call can be called
-directly.
+compile more leaf functions to directly callable code, such as those
+without "+float" or with more than one statement.  It may be necessary
+to delay all code gen to C<CHECK> time so that functions defined after
+their call can be called directly.
 
 =back
 
@@ -356,7 +929,8 @@ the file preamble (from C<share/header.c>) nor the function headers.
 =item C<r> - report when the generated code registers itself with
 Faster::Maths::CC.
 
-=item C<b> - print a line for each step of the build process.
+=item C<b> - print a line for each step of the build process,
+including cache hits and stores.
 
 =item C<x> - prevents build output being redirected to F</dev/null>.
 
@@ -372,13 +946,96 @@ OPs.
 =item C<S> - include the op sequence number (as with -Dx) when
 reporting OP addresses.  This is not thread safe.
 
+=item C<i> - dump the integer only version of each fragment as it's
+built and after each of the L</PERL_FMC_PASSES>.
+
 =back
 
+=item C<PERL_FMC_CACHE>
+
+The directory used to cache built XS modules.  Defaults to
+F<faster-maths-cc> under C<$XDG_CACHE_HOME>, or F<~/.cache> if that
+isn't set.  Set to an empty string to disable caching.
+
+The directory is never pruned: each change to the compiled code adds
+a new entry, and old entries are kept even if nothing uses them any
+more, so the cache grows until it's cleaned up by hand.  It's safe to
+delete the directory or any entries within it when no process is
+building into it.
+
+=item C<PERL_FMC_BACKEND>
+
+How the generated code is built and loaded:
+
+=over
+
+=item C<cc> - compile the generated C directly to a shared object
+with a single compiler run, and load that.  This is the default,
+except on Windows.
+
+=item C<make> - generate an XS module and build it with
+F<Makefile.PL> and C<make>.  Slower, but uses MakeMaker's full
+knowledge of the platform.  This is the default on Windows.
+
+=back
+
+=item C<PERL_FMC_BACKGROUND>
+
+If set to non-zero, builds that aren't found in the cache are done in
+a forked child process rather than delaying program start up, or the
+first call to late compiled code.  The original OPs are used until
+the build finishes and is loaded.  Ignored on systems without
+C<fork()>.
+
+=item C<PERL_FMC_PROFILE>
+
+The name of a type profile file.  If set, the kinds of value (integer,
+floating point, string and so on) read by each fragment that has an
+integer only version are counted as the program runs, whether the
+generated code or the original OPs run, and added to the file on
+exit.  When the file exists it's read at startup, and a fragment whose
+inputs were found to mostly not be integers is generated without the
+integer only version, since its entry check would usually fail.
+
+Fragments are matched to the profile by the order they're generated
+and their source line, so the profile only applies to the same code,
+and counts for code that has changed are discarded.  Counting adds a
+small cost to each call of those fragments.
+
+=item C<PERL_FMC_PASSES>
+
+A comma separated list of the optimisation passes to run, in order,
+over the integer only version of each fragment.  Defaults to all of
+them, C<forward,fold,cse,dce>:
+
+=over
+
+=item C<forward> - use the value stored to or read from a variable
+rather than reading it again.
+
+=item C<fold> - work out arithmetic and comparisons on constants
+when generating the code.
+
+=item C<cse> - compute arithmetic repeated on the same values once.
+
+=item C<dce> - drop arithmetic whose result isn't used.
+
+=back
+
+Set it to an empty string to run none, or to a single pass to measure
+its effect.  Passes may be repeated.  An unknown pass is warned about
+and skipped.
+
+These passes don't yet apply to the generic version of each
+fragment, which still shares repeated arithmetic, picks C numbers over
+SVs and writes constants as literals as it's generated.
+
 =item C<PERL_FMC_KEEP>
 
 If set to non-zero the build directory for the generated XS module
 isn't cleaned up on exit and the path to the build directory will be
-written to STDERR.
+written to STDERR.  A successful build into the cache is kept
+regardless.
 
 =item C<PERL_FMC_MAKEFILEPL>
 
@@ -386,7 +1043,8 @@ Extra options passed to F<Makefile.PL>.  For example you might set:
 
   PERL_FMC_MAKEFILEPL="OPTIMIZE='-O0 -ggdb3'"
 
-If you want to use a debugger on the generated XS code.
+If you want to use a debugger on the generated XS code.  This is only
+used by the C<make> backend, so set C<PERL_FMC_BACKEND=make> too.
 
 =back
 
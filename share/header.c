@@ -8,7 +8,7 @@
 #include "ppport.h"
 #include <assert.h>
 
-typedef void (*fragment_handler)(pTHX_ const UNOP_AUX_item *aux);
+typedef OP *(*fragment_handler)(pTHX_ const UNOP_AUX_item *aux);
 
 #define assert_AMAGIC() \
   assert(!(PL_curcop->cop_hints & HINT_NO_AMAGIC))
@@ -128,6 +128,20 @@ my_try_amagic_un(pTHX_ SV **psv, int method, int flags) {
       ? do_try_amagic_un(aTHX_ psv, method, flags) : NULL;
 }
 
+// unary overloading for ops that can assign directly to a lexical
+// (OPpTARGET_MY), an overload result is copied to out if mutator
+PERL_STATIC_INLINE SV *
+my_try_amagic_un_targ(pTHX_ SV *out, SV **psv, int method, int flags,
+                      bool mutator) {
+    SV *result = my_try_amagic_un(aTHX_ psv, method, flags);
+    if (result && mutator) {
+        sv_setsv(out, result);
+        SvSETMAGIC(out);
+        return out;
+    }
+    return result;
+}
+
 // set the IV for a SV if the SV is simple
 // adapted from TARGi()
 static inline void
@@ -1030,6 +1044,382 @@ do_divide_ovfloat(pTHX_ SV *out, SV *left, SV *right,
     return out;
 }
 
+// modulus of two SVs, magic and amagic must have been handled already
+// adapted from pp_modulo
+static void
+do_modulo_raw(pTHX_ SV *out, SV *svl, SV *svr) {
+    UV left  = 0;
+    UV right = 0;
+    bool left_neg = FALSE;
+    bool right_neg = FALSE;
+    bool use_double = FALSE;
+    bool dright_valid = FALSE;
+    NV dright = 0.0;
+    NV dleft  = 0.0;
+
+    if (SvIV_please_nomg(svr)) {
+        right_neg = !SvUOK(svr);
+        if (!right_neg) {
+            right = SvUVX(svr);
+        } else {
+            const IV biv = SvIVX(svr);
+            if (biv >= 0) {
+                right = biv;
+                right_neg = FALSE; /* effectively it's a UV now */
+            } else {
+                right = NEGATE_2UV(biv);
+            }
+        }
+    }
+    else {
+        dright = SvNV_nomg(svr);
+        right_neg = dright < 0;
+        if (right_neg)
+            dright = -dright;
+        if (dright < UV_MAX_P1) {
+            right = U_V(dright);
+            dright_valid = TRUE; /* In case we need to use double below.  */
+        } else {
+            use_double = TRUE;
+        }
+    }
+
+    /* At this point use_double is only true if right is out of range for
+       a UV.  In range NV has been rounded down to nearest UV and
+       use_double false.  */
+    if (!use_double && SvIV_please_nomg(svl)) {
+        left_neg = !SvUOK(svl);
+        if (!left_neg) {
+            left = SvUVX(svl);
+        } else {
+            const IV aiv = SvIVX(svl);
+            if (aiv >= 0) {
+                left = aiv;
+                left_neg = FALSE; /* effectively it's a UV now */
+            } else {
+                left = NEGATE_2UV(aiv);
+            }
+        }
+    }
+    else {
+        dleft = SvNV_nomg(svl);
+        left_neg = dleft < 0;
+        if (left_neg)
+            dleft = -dleft;
+
+        /* This should be exactly the 5.6 behaviour - if left and right are
+           both in range for UV then use U_V() rather than floor.  */
+        if (!use_double) {
+            if (dleft < UV_MAX_P1) {
+                /* right was in range, so is dleft, so use UVs not double.
+                 */
+                left = U_V(dleft);
+            }
+            /* left is out of range for UV, right was in range, so promote
+               right (back) to double.  */
+            else {
+                /* The +0.5 is used in 5.6 even though it is not strictly
+                   consistent with the implicit +0 floor in the U_V()
+                   inside the #if 1. */
+                dleft = Perl_floor(dleft + 0.5);
+                use_double = TRUE;
+                if (dright_valid)
+                    dright = Perl_floor(dright + 0.5);
+                else
+                    dright = right;
+            }
+        }
+    }
+    if (use_double) {
+        NV dans;
+
+        if (!dright)
+            croak("Illegal modulus zero");
+
+        dans = Perl_fmod(dleft, dright);
+        if ((left_neg != right_neg) && dans)
+            dans = dright - dans;
+        if (right_neg)
+            dans = -dans;
+        fast_sv_setnv(aTHX_ out, dans);
+    }
+    else {
+        UV ans;
+
+        if (!right)
+            croak("Illegal modulus zero");
+
+        ans = left % right;
+        if ((left_neg != right_neg) && ans)
+            ans = right - ans;
+        if (right_neg) {
+            if (ans <= ABS_IV_MIN)
+                fast_sv_setiv(aTHX_ out, NEGATE_2IV(ans));
+            else
+                fast_sv_setnv(aTHX_ out, -(NV)ans);
+        }
+        else
+            fast_sv_setuv(aTHX_ out, ans);
+    }
+}
+
+// modulus of two NVs, for "+float"
+// this is the NV only path through pp_modulo, so the operands are
+// still truncated to integers when they fit in a UV
+static inline NV
+do_modulo_nv(pTHX_ NV left, NV right) {
+    bool left_neg = left < 0;
+    bool right_neg = right < 0;
+    bool use_double = FALSE;
+    if (left_neg)
+        left = -left;
+    if (right_neg)
+        right = -right;
+
+    /* As pp_modulo: a right out of range for a UV is used as is, a
+       left out of range with right in range rounds both.  */
+    if (!(right < UV_MAX_P1))
+        use_double = TRUE;
+    else if (!(left < UV_MAX_P1)) {
+        left = Perl_floor(left + 0.5);
+        right = Perl_floor(right + 0.5);
+        use_double = TRUE;
+    }
+
+    NV ans;
+    if (use_double) {
+        if (!right)
+            croak("Illegal modulus zero");
+        ans = Perl_fmod(left, right);
+        if ((left_neg != right_neg) && ans)
+            ans = right - ans;
+    }
+    else {
+        UV uleft = U_V(left);
+        UV uright = U_V(right);
+        if (!uright)
+            croak("Illegal modulus zero");
+        UV uans = uleft % uright;
+        if ((left_neg != right_neg) && uans)
+            uans = uright - uans;
+        ans = (NV)uans;
+    }
+
+    return right_neg ? -ans : ans;
+}
+
+// modulus of two SVs, handling magic and overloading
+static inline SV *
+do_modulo(pTHX_ SV *out, SV *left, SV *right, int amagic_flags,
+          bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, modulo_amg,
+                                   amagic_flags | AMGf_numeric, mutator);
+    if (result)
+        return result;
+    do_modulo_raw(aTHX_ out, left, right);
+    return out;
+}
+
+// modulus of two SVs, ignoring overloading
+static inline void
+do_modulo_noov(pTHX_ SV *out, SV *svl, SV *svr) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(svl);
+    if (svl != svr)
+        SvGETMAGIC(svr);
+    svl = my_sv_2num_noov(aTHX_ svl);
+    svr = my_sv_2num_noov(aTHX_ svr);
+    do_modulo_raw(aTHX_ out, svl, svr);
+}
+
+// modulus of two SVs, handling overloading, but working in NVs
+static inline SV *
+do_modulo_ovfloat(pTHX_ SV *out, SV *left, SV *right,
+                  int amagic_flags, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, modulo_amg,
+                                   amagic_flags | AMGf_numeric, mutator);
+    if (result)
+        return result;
+
+    fast_sv_setnv(aTHX_ out,
+                  do_modulo_nv(aTHX_ SvNV_nomg(left), SvNV_nomg(right)));
+
+    return out;
+}
+
+// raise one SV to the power of another, magic and amagic must have
+// been handled already
+// adapted from pp_pow
+static void
+do_pow_raw(pTHX_ SV *out, SV *svl, SV *svr) {
+#ifdef PERL_PRESERVE_IVUV
+    bool is_int = 0;
+
+    /* first of all, deal with integer to integer power specially */
+    if (SvIV_please_nomg(svr) && SvIV_please_nomg(svl)) {
+        UV power;
+        bool baseuok;
+        UV baseuv;
+
+        if (SvUOK(svr)) {
+            power = SvUVX(svr);
+        } else {
+            const IV iv = SvIVX(svr);
+            if (iv >= 0) {
+                power = iv;
+            } else {
+                goto float_it; /* Can't do negative powers this way.  */
+            }
+        }
+
+        baseuok = SvUOK(svl);
+        if (baseuok) {
+            baseuv = SvUVX(svl);
+        } else {
+            const IV iv = SvIVX(svl);
+            if (iv >= 0) {
+                baseuv = iv;
+                baseuok = TRUE; /* effectively it's a UV now */
+            } else {
+                baseuv = NEGATE_2UV(iv); /* abs, baseuok == false records sign */
+            }
+        }
+        /* now we have integer ** positive integer. */
+        is_int = 1;
+
+        /* foo & (foo - 1) is zero only for a power of 2.  */
+        if (!(baseuv & (baseuv - 1))) {
+            /* We are raising power-of-2 to a positive integer.
+               The logic here will work for any base (even non-integer
+               bases) but it can be less accurate than
+               pow (base,power) or exp (power * log (base)) when the
+               intermediate values start to spill out of the mantissa.
+               With powers of 2 we know this can't happen.
+               And powers of 2 are the favourite thing for perl
+               programmers to notice ** not doing what they mean. */
+            NV result = 1.0;
+            NV base = baseuok ? baseuv : -(NV)baseuv;
+
+            IV n = 0;
+            for (; power; base *= base, n++) {
+                const UV bit = (UV)1 << (UV)n;
+                if (power & bit) {
+                    result *= base;
+                    /* Only bother to clear the bit if it is set.  */
+                    power -= bit;
+                    /* Avoid squaring base again if we're done. */
+                    if (power == 0) break;
+                }
+            }
+            fast_sv_setnv(aTHX_ out, result);
+            SvIV_please_nomg(out);
+            return;
+        } else {
+            unsigned int highbit = 8 * sizeof(baseuv);
+            unsigned int diff = 8 * sizeof(baseuv);
+            while (diff >>= 1) {
+                highbit -= diff;
+                if ((baseuv >> highbit) != 0) {
+                    highbit += diff;
+                }
+            }
+            /* we now have baseuv < 2 ** highbit */
+            if (power * highbit <= 52) {
+                /* result will definitely fit in UV, so use UV math
+                   on same algorithm as above */
+                UV result = 1;
+                UV base = baseuv;
+                const bool odd_power = cBOOL(power & 1);
+                if (odd_power) {
+                    result *= base;
+                }
+                while (power >>= 1) {
+                    base *= base;
+                    if (power & 1) {
+                        result *= base;
+                    }
+                }
+                if (baseuok || !odd_power)
+                    /* answer is positive */
+                    fast_sv_setnv(aTHX_ out, (NV)result);
+                else if (result <= (UV)IV_MAX)
+                    /* answer negative, fits in IV */
+                    fast_sv_setiv(aTHX_ out, -(IV)result);
+                else if (result == (UV)IV_MIN)
+                    /* 2's complement assumption: special case IV_MIN */
+                    fast_sv_setiv(aTHX_ out, IV_MIN);
+                else
+                    /* answer negative, doesn't fit */
+                    fast_sv_setnv(aTHX_ out, -(NV)result);
+                return;
+            }
+        }
+    }
+  float_it:
+#endif
+    {
+        NV right = SvNV_nomg(svr);
+        NV left  = SvNV_nomg(svl);
+
+        fast_sv_setnv(aTHX_ out, Perl_pow(left, right));
+#ifdef PERL_PRESERVE_IVUV
+        if (is_int)
+            SvIV_please_nomg(out);
+#endif
+    }
+}
+
+// ** for NVs, for "+float"
+static inline NV
+do_pow_nv(pTHX_ NV left, NV right) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_pow(left, right);
+}
+
+// raise one SV to the power of another, handling magic and
+// overloading
+static inline SV *
+do_pow(pTHX_ SV *out, SV *left, SV *right, int amagic_flags,
+       bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, pow_amg,
+                                   amagic_flags | AMGf_numeric, mutator);
+    if (result)
+        return result;
+    do_pow_raw(aTHX_ out, left, right);
+    return out;
+}
+
+// raise one SV to the power of another, ignoring overloading
+static inline void
+do_pow_noov(pTHX_ SV *out, SV *svl, SV *svr) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(svl);
+    if (svl != svr)
+        SvGETMAGIC(svr);
+    svl = my_sv_2num_noov(aTHX_ svl);
+    svr = my_sv_2num_noov(aTHX_ svr);
+    do_pow_raw(aTHX_ out, svl, svr);
+}
+
+// raise one SV to the power of another, handling overloading, but
+// working in NVs
+static inline SV *
+do_pow_ovfloat(pTHX_ SV *out, SV *left, SV *right,
+               int amagic_flags, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, pow_amg,
+                                   amagic_flags | AMGf_numeric, mutator);
+    if (result)
+        return result;
+
+    fast_sv_setnv(aTHX_ out, Perl_pow(SvNV_nomg(left), SvNV_nomg(right)));
+
+    return out;
+}
+
 // negate a string if it doesn't look numeric
 static bool
 my_negate_string(pTHX_ SV *out, SV *sv) {
@@ -1142,4 +1532,1188 @@ do_negate_noov(pTHX_ SV *out, SV *sv) {
     do_negate_low(aTHX_ out, sv);
 }
 
+// Define the wrappers for the floating point function NAME, one of
+// sin, cos, exp, log or sqrt, adapted from pp_sin:
+//
+// do_NAME() - supports magic and overloading
+// do_NAME_noov() - for "no overloading;"
+// do_NAME_nv() - on NVs, for raw NVs without overloading
+//
+// These always produce an NV so "+float" makes no difference.  bad is
+// the condition on value that perl dies on.
+#define DEFINE_NV_FUNC(name, bad) \
+static inline NV \
+do_##name##_nv(pTHX_ NV value) { \
+    if (bad) \
+        croak("Can't take %s of %" NVgf, #name, value); \
+    return Perl_##name(value); \
+} \
+\
+static inline SV * \
+do_##name(pTHX_ SV *out, SV *sv, bool mutator) { \
+    assert_AMAGIC(); \
+    SV *result = my_try_amagic_un_targ(aTHX_ out, &sv, name##_amg, 0, \
+                                       mutator); \
+    if (result) \
+        return result; \
+    fast_sv_setnv(aTHX_ out, do_##name##_nv(aTHX_ SvNV_nomg(sv))); \
+    return out; \
+} \
+\
+static inline void \
+do_##name##_noov(pTHX_ SV *out, SV *sv) { \
+    assert_NO_AMAGIC(); \
+    SvGETMAGIC(sv); \
+    fast_sv_setnv(aTHX_ out, do_##name##_nv(aTHX_ SvNV_nomg(sv))); \
+}
+
+DEFINE_NV_FUNC(sin, 0)
+DEFINE_NV_FUNC(cos, 0)
+DEFINE_NV_FUNC(exp, 0)
+DEFINE_NV_FUNC(log, value <= 0.0)
+DEFINE_NV_FUNC(sqrt, value < 0.0)
+
+// atan2() for NVs, for raw NVs without overloading
+static inline NV
+do_atan2_nv(pTHX_ NV left, NV right) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_atan2(left, right);
+}
+
+// atan2() with magic and overloading, adapted from pp_atan2
+static inline SV *
+do_atan2(pTHX_ SV *out, SV *left, SV *right, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, atan2_amg, 0,
+                                   mutator);
+    if (result)
+        return result;
+    NV nr = SvNV_nomg(right);
+    fast_sv_setnv(aTHX_ out, Perl_atan2(SvNV_nomg(left), nr));
+    return out;
+}
+
+// atan2() for "no overloading;"
+static inline void
+do_atan2_noov(pTHX_ SV *out, SV *left, SV *right) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(left);
+    if (left != right)
+        SvGETMAGIC(right);
+    NV nr = SvNV_nomg(right);
+    fast_sv_setnv(aTHX_ out, Perl_atan2(SvNV_nomg(left), nr));
+}
+
+// abs() of an SV, preserving integers, magic and amagic should
+// already have been handled
+// adapted from pp_abs
+static void
+do_abs_raw(pTHX_ SV *out, SV *sv) {
+    /* This will cache the NV value if string isn't actually integer  */
+    const IV iv = SvIV_nomg(sv);
+    UV uv;
+
+    if (!SvOK(sv)) {
+        uv = 0;
+        goto set_uv;
+    }
+    else if (SvIOK(sv)) {
+        /* IVs are fast - IV_MIN rolls over to UV_MIN. */
+        if (SvIsUV(sv))
+            uv = SvUVX(sv);     /* force it to be numeric only */
+        else if (iv >= 0) {
+            uv = (UV)iv;
+        } else {
+            /* "(UV)-(iv + 1) + 1" below is mathematically "-iv", but
+               transformed so that every subexpression will never trigger
+               overflows even on 2's complement representation (note that
+               iv is always < 0 here), and modern compilers could optimize
+               this to a single negation.  */
+            uv = (UV)-(iv + 1) + 1;
+        }
+      set_uv:
+        fast_sv_setuv(aTHX_ out, uv);
+    }
+    else {
+        fast_sv_setnv(aTHX_ out, Perl_fabs(SvNV_nomg(sv)));
+    }
+}
+
+// abs() for raw NVs, used for "+float"
+static inline NV
+do_abs_nv(pTHX_ NV value) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_fabs(value);
+}
+
+// abs() with magic and overloading
+static inline SV *
+do_abs(pTHX_ SV *out, SV *sv, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_un_targ(aTHX_ out, &sv, abs_amg,
+                                       AMGf_numeric, mutator);
+    if (result)
+        return result;
+    do_abs_raw(aTHX_ out, sv);
+    return out;
+}
+
+// abs() with overloading, but not preserving integers
+static inline SV *
+do_abs_ovfloat(pTHX_ SV *out, SV *sv, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_un_targ(aTHX_ out, &sv, abs_amg,
+                                       AMGf_numeric, mutator);
+    if (result)
+        return result;
+    fast_sv_setnv(aTHX_ out, Perl_fabs(SvNV_nomg(sv)));
+    return out;
+}
+
+// abs() for "no overloading;"
+static inline void
+do_abs_noov(pTHX_ SV *out, SV *sv) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(sv);
+    sv = my_sv_2num_noov(aTHX_ sv);
+    do_abs_raw(aTHX_ out, sv);
+}
+
+// int() of an SV, preserving integers, magic and amagic should
+// already have been handled
+// adapted from pp_int
+static void
+do_int_raw(pTHX_ SV *out, SV *sv) {
+    const IV iv = SvIV_nomg(sv);
+    /* XXX it's arguable that compiler casting to IV might be subtly
+       different from modf (for numbers inside (IV_MIN,UV_MAX)) in which
+       else preferring IV has introduced a subtle behaviour change bug. OTOH
+       relying on floating point to be accurate is a bug.  */
+
+    if (!SvOK(sv)) {
+        fast_sv_setuv(aTHX_ out, 0);
+    }
+    else if (SvIOK(sv)) {
+        if (SvIsUV(sv))
+            fast_sv_setuv(aTHX_ out, SvUV_nomg(sv));
+        else
+            fast_sv_setiv(aTHX_ out, iv);
+    }
+    else {
+        const NV value = SvNV_nomg(sv);
+        if (UNLIKELY(Perl_isinfnan(value)))
+            fast_sv_setnv(aTHX_ out, value);
+        else if (value >= 0.0) {
+            if (value < (NV)UV_MAX + 0.5) {
+                fast_sv_setuv(aTHX_ out, U_V(value));
+            } else {
+                fast_sv_setnv(aTHX_ out, Perl_floor(value));
+            }
+        }
+        else {
+            if (value > (NV)IV_MIN - 0.5) {
+                fast_sv_setiv(aTHX_ out, I_V(value));
+            } else {
+                fast_sv_setnv(aTHX_ out, Perl_ceil(value));
+            }
+        }
+    }
+}
+
+// int() for raw NVs, used for "+float"
+static inline NV
+do_int_nv(pTHX_ NV value) {
+    PERL_UNUSED_CONTEXT;
+    if (UNLIKELY(Perl_isinfnan(value)))
+        return value;
+    return value >= 0.0 ? Perl_floor(value) : Perl_ceil(value);
+}
+
+// int() with magic and overloading
+static inline SV *
+do_int(pTHX_ SV *out, SV *sv, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_un_targ(aTHX_ out, &sv, int_amg,
+                                       AMGf_numeric, mutator);
+    if (result)
+        return result;
+    do_int_raw(aTHX_ out, sv);
+    return out;
+}
+
+// int() with overloading, but not preserving integers
+static inline SV *
+do_int_ovfloat(pTHX_ SV *out, SV *sv, bool mutator) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_un_targ(aTHX_ out, &sv, int_amg,
+                                       AMGf_numeric, mutator);
+    if (result)
+        return result;
+    fast_sv_setnv(aTHX_ out, do_int_nv(aTHX_ SvNV_nomg(sv)));
+    return out;
+}
+
+// int() for "no overloading;"
+static inline void
+do_int_noov(pTHX_ SV *out, SV *sv) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(sv);
+    sv = my_sv_2num_noov(aTHX_ sv);
+    do_int_raw(aTHX_ out, sv);
+}
+
+// POSIX functions called directly instead of via entersub, these
+// take and return NVs just as the XSUBs do, the XSUB's typemap
+// numifies the argument with SvNV(), overloading included
+static inline NV
+do_posix_floor(pTHX_ NV value) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_floor(value);
+}
+
+static inline NV
+do_posix_ceil(pTHX_ NV value) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_ceil(value);
+}
+
+static inline NV
+do_posix_fmod(pTHX_ NV left, NV right) {
+    PERL_UNUSED_CONTEXT;
+    return Perl_fmod(left, right);
+}
+
+// the numeric value List::Util works with
+#define slu_sv_value(sv) \
+    (SvIOK(sv) ? (SvIOK_UV(sv) ? (NV)SvUVX(sv) : (NV)SvIVX(sv)) : SvNV(sv))
+
+// List::Util::min() and max() called directly, returns the
+// winning SV itself, as the XSUB does
+// adapted from ListUtil.xs
+static SV *
+do_list_minmax(pTHX_ SV **args, SSize_t count, bool want_max) {
+    SV *retsv = args[0];
+    SvGETMAGIC(retsv);
+    bool magic = SvAMAGIC(retsv);
+    NV retnv = 0.0;
+    if (!magic)
+        retnv = slu_sv_value(retsv);
+
+    for (SSize_t index = 1; index < count; ++index) {
+        SV *stacksv = args[index];
+        SV *tmpsv;
+        SvGETMAGIC(stacksv);
+        if ((magic || SvAMAGIC(stacksv)) &&
+            (tmpsv = amagic_call(retsv, stacksv, gt_amg, 0))) {
+            if (SvTRUE(tmpsv) ? !want_max : want_max) {
+                retsv = stacksv;
+                magic = SvAMAGIC(retsv);
+                if (!magic)
+                    retnv = slu_sv_value(retsv);
+            }
+        }
+        else {
+            NV val = slu_sv_value(stacksv);
+            if (magic) {
+                retnv = slu_sv_value(retsv);
+                magic = false;
+            }
+            if (val < retnv ? !want_max : want_max) {
+                retsv = stacksv;
+                retnv = val;
+            }
+        }
+    }
+
+    return retsv;
+}
+
+static inline SV *
+do_list_min(pTHX_ SV *out, SV **args, SSize_t count) {
+    PERL_UNUSED_ARG(out);
+    return do_list_minmax(aTHX_ args, count, false);
+}
+
+static inline SV *
+do_list_max(pTHX_ SV *out, SV **args, SSize_t count) {
+    PERL_UNUSED_ARG(out);
+    return do_list_minmax(aTHX_ args, count, true);
+}
+
+enum slu_accum { ACC_IV, ACC_NV, ACC_SV };
+
+static inline enum slu_accum
+slu_accum_type(SV *sv) {
+    if (SvAMAGIC(sv))
+        return ACC_SV;
+    if (SvIOK(sv) && !SvNOK(sv) && !SvUOK(sv))
+        return ACC_IV;
+    return ACC_NV;
+}
+
+// List::Util::sum() called directly, the result is in out (the
+// entersub target) or is the result of an overloaded +
+// adapted from ListUtil.xs
+static SV *
+do_list_sum(pTHX_ SV *out, SV **args, SSize_t count) {
+    IV retiv = 0;
+    NV retnv = 0.0;
+    SV *retsv = NULL;
+    SV *sv = args[0];
+    SvGETMAGIC(sv);
+    enum slu_accum accum = slu_accum_type(sv);
+    switch (accum) {
+    case ACC_SV:
+        retsv = out;
+        sv_setsv_nomg(retsv, sv);
+        break;
+    case ACC_IV:
+        retiv = SvIV_nomg(sv);
+        break;
+    case ACC_NV:
+    default:
+        retnv = slu_sv_value(sv);
+        break;
+    }
+
+    for (SSize_t index = 1; index < count; ++index) {
+        sv = args[index];
+        SvGETMAGIC(sv);
+        if (accum < ACC_SV && SvAMAGIC(sv)) {
+            if (!retsv)
+                retsv = out;
+            sv_setnv(retsv, accum == ACC_NV ? retnv : (NV)retiv);
+            accum = ACC_SV;
+        }
+        switch (accum) {
+        case ACC_SV: {
+            SV *tmpsv = amagic_call(retsv, sv, add_amg,
+                                    SvAMAGIC(retsv) ? AMGf_assign : 0);
+            if (tmpsv) {
+                switch ((accum = slu_accum_type(tmpsv))) {
+                case ACC_SV:
+                    retsv = tmpsv;
+                    break;
+                case ACC_IV:
+                    retiv = SvIV(tmpsv);
+                    break;
+                case ACC_NV:
+                default:
+                    retnv = slu_sv_value(tmpsv);
+                    break;
+                }
+            }
+            else {
+                /* fall back to default */
+                accum = ACC_NV;
+                retnv = SvNV(retsv) + SvNV(sv);
+            }
+        } break;
+
+        case ACC_IV:
+            if (!SvNOK(sv) && SvIOK(sv)) {
+                IV i = SvIV(sv);
+                if (retiv >= 0 && i >= 0) {
+                    if (retiv <= IV_MAX - i) {
+                        retiv += i;
+                        break;
+                    }
+                }
+                else if (retiv < 0 && i < 0) {
+                    if (i >= IV_MIN - retiv) {
+                        retiv += i;
+                        break;
+                    }
+                }
+                else {
+                    /* mixed signs can't overflow */
+                    retiv += i;
+                    break;
+                }
+            }
+            retnv = retiv + 0.0;
+            accum = ACC_NV;
+            /* FALLTHROUGH */
+        case ACC_NV:
+            retnv += slu_sv_value(sv);
+            break;
+        }
+    }
+
+    if (!retsv)
+        retsv = out;
+
+    switch (accum) {
+    case ACC_SV: /* nothing to do */
+        break;
+    case ACC_IV:
+        sv_setiv(retsv, retiv);
+        break;
+    case ACC_NV:
+        sv_setnv(retsv, retnv);
+        break;
+    }
+
+    return retsv;
+}
+
+// numeric comparison, returns -1, 0, 1, or 2 for NaN
+// adapted from Perl_do_ncmp(), which isn't API either
+// magic and overloading must already have been handled
+static I32
+my_do_ncmp(pTHX_ SV *left, SV *right) {
+#ifdef PERL_PRESERVE_IVUV
+    /* Fortunately it seems NaN isn't IOK */
+    if (SvIV_please_nomg(right) && SvIV_please_nomg(left)) {
+        if (!SvUOK(left)) {
+            const IV leftiv = SvIVX(left);
+            if (!SvUOK(right)) {
+                /* ## IV <=> IV ## */
+                const IV rightiv = SvIVX(right);
+                return (leftiv > rightiv) - (leftiv < rightiv);
+            }
+            /* ## IV <=> UV ## */
+            if (leftiv < 0)
+                /* As (b) is a UV, it's >=0, so it must be < */
+                return -1;
+            {
+                const UV rightuv = SvUVX(right);
+                return ((UV)leftiv > rightuv) - ((UV)leftiv < rightuv);
+            }
+        }
+
+        if (SvUOK(right)) {
+            /* ## UV <=> UV ## */
+            const UV leftuv = SvUVX(left);
+            const UV rightuv = SvUVX(right);
+            return (leftuv > rightuv) - (leftuv < rightuv);
+        }
+        /* ## UV <=> IV ## */
+        {
+            const IV rightiv = SvIVX(right);
+            if (rightiv < 0)
+                /* As (a) is a UV, it's >=0, so it cannot be < */
+                return 1;
+            {
+                const UV leftuv = SvUVX(left);
+                return (leftuv > (UV)rightiv) - (leftuv < (UV)rightiv);
+            }
+        }
+        NOT_REACHED; /* NOTREACHED */
+    }
+#endif
+    {
+        NV const rnv = SvNV_nomg(right);
+        NV const lnv = SvNV_nomg(left);
+
+#if defined(NAN_COMPARE_BROKEN) && defined(Perl_isnan)
+        if (Perl_isnan(lnv) || Perl_isnan(rnv)) {
+            return 2;
+        }
+        return (lnv > rnv) - (lnv < rnv);
+#else
+        if (lnv < rnv)
+            return -1;
+        if (lnv > rnv)
+            return 1;
+        if (lnv == rnv)
+            return 0;
+        return 2;
+#endif
+    }
+}
+
+// numeric comparisons, adapted from pp_lt etc.
+// magic and overloading must already have been handled
+//
+// The simple IV and NV cases are handled inline, otherwise we fall back
+// to my_do_ncmp().
+#define SIMPLE_IV_CMP(left, right) \
+    ((SvFLAGS(left) & SvFLAGS(right) & SVf_IOK) \
+     && !((SvFLAGS(left) | SvFLAGS(right)) & SVf_IVisUV))
+#define SIMPLE_NV_CMP(left, right) \
+    (SvFLAGS(left) & SvFLAGS(right) & SVf_NOK)
+
+static inline bool
+do_lt_raw(pTHX_ SV *left, SV *right) {
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) < SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) < SvNVX(right)
+         : my_do_ncmp(aTHX_ left, right) == -1;
+}
+
+static inline bool
+do_gt_raw(pTHX_ SV *left, SV *right) {
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) > SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) > SvNVX(right)
+         : my_do_ncmp(aTHX_ left, right) == 1;
+}
+
+static inline bool
+do_le_raw(pTHX_ SV *left, SV *right) {
+    I32 cmp;
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) <= SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) <= SvNVX(right)
+         : ((cmp = my_do_ncmp(aTHX_ left, right)) == -1 || cmp == 0);
+}
+
+static inline bool
+do_ge_raw(pTHX_ SV *left, SV *right) {
+    I32 cmp;
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) >= SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) >= SvNVX(right)
+         : ((cmp = my_do_ncmp(aTHX_ left, right)) == 1 || cmp == 0);
+}
+
+static inline bool
+do_eq_raw(pTHX_ SV *left, SV *right) {
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) == SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) == SvNVX(right)
+         : my_do_ncmp(aTHX_ left, right) == 0;
+}
+
+static inline bool
+do_ne_raw(pTHX_ SV *left, SV *right) {
+    return SIMPLE_IV_CMP(left, right) ? SvIVX(left) != SvIVX(right)
+         : SIMPLE_NV_CMP(left, right) ? SvNVX(left) != SvNVX(right)
+         : my_do_ncmp(aTHX_ left, right) != 0;
+}
+
+// Define the wrappers for the numeric comparison NAME:
+//
+// do_NAME() - supports magic and overloading
+// do_NAME_noov() - for "no overloading;"
+// do_NAME_ovfloat() - supports overloading, but compares as NVs
+//
+// None of these need a target, the result is an overload result,
+// &PL_sv_yes or &PL_sv_no.
+#define DEFINE_NUM_COMPARE(name, method, op) \
+static inline SV * \
+do_##name(pTHX_ SV *left, SV *right, int amagic_flags) { \
+    assert_AMAGIC(); \
+    SV *result = my_try_amagic_bin(aTHX_ NULL, &left, &right, method, \
+                                   amagic_flags | AMGf_numeric, false); \
+    if (result) \
+        return result; \
+    return boolSV(do_##name##_raw(aTHX_ left, right)); \
+} \
+\
+static inline SV * \
+do_##name##_noov(pTHX_ SV *left, SV *right) { \
+    assert_NO_AMAGIC(); \
+    SvGETMAGIC(left); \
+    if (left != right) \
+        SvGETMAGIC(right); \
+    left = my_sv_2num_noov(aTHX_ left); \
+    right = my_sv_2num_noov(aTHX_ right); \
+    return boolSV(do_##name##_raw(aTHX_ left, right)); \
+} \
+\
+static inline SV * \
+do_##name##_ovfloat(pTHX_ SV *left, SV *right, int amagic_flags) { \
+    assert_AMAGIC(); \
+    SV *result = my_try_amagic_bin(aTHX_ NULL, &left, &right, method, \
+                                   amagic_flags | AMGf_numeric, false); \
+    if (result) \
+        return result; \
+    return boolSV(SvNV_nomg(left) op SvNV_nomg(right)); \
+}
+
+DEFINE_NUM_COMPARE(lt, lt_amg, <)
+DEFINE_NUM_COMPARE(gt, gt_amg, >)
+DEFINE_NUM_COMPARE(le, le_amg, <=)
+DEFINE_NUM_COMPARE(ge, ge_amg, >=)
+DEFINE_NUM_COMPARE(eq, eq_amg, ==)
+DEFINE_NUM_COMPARE(ne, ne_amg, !=)
+
+// <=> for NVs, also used for "+float"
+static inline SV *
+do_ncmp_float(pTHX_ SV *out, NV left, NV right) {
+    if (left < right)
+        fast_sv_setiv(aTHX_ out, -1);
+    else if (left > right)
+        fast_sv_setiv(aTHX_ out, 1);
+    else if (left == right)
+        fast_sv_setiv(aTHX_ out, 0);
+    else
+        return &PL_sv_undef;
+    return out;
+}
+
+// <=> with magic and overloading, adapted from pp_ncmp
+static inline SV *
+do_ncmp(pTHX_ SV *out, SV *left, SV *right, int amagic_flags) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, ncmp_amg,
+                                   amagic_flags | AMGf_numeric, false);
+    if (result)
+        return result;
+    I32 value = my_do_ncmp(aTHX_ left, right);
+    if (value == 2)
+        return &PL_sv_undef;
+    fast_sv_setiv(aTHX_ out, value);
+    return out;
+}
+
+// <=> for "no overloading;"
+static inline SV *
+do_ncmp_noov(pTHX_ SV *out, SV *left, SV *right) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(left);
+    if (left != right)
+        SvGETMAGIC(right);
+    left = my_sv_2num_noov(aTHX_ left);
+    right = my_sv_2num_noov(aTHX_ right);
+    I32 value = my_do_ncmp(aTHX_ left, right);
+    if (value == 2)
+        return &PL_sv_undef;
+    fast_sv_setiv(aTHX_ out, value);
+    return out;
+}
+
+// <=> with overloading, but comparing as NVs
+static inline SV *
+do_ncmp_ovfloat(pTHX_ SV *out, SV *left, SV *right, int amagic_flags) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, ncmp_amg,
+                                   amagic_flags | AMGf_numeric, false);
+    if (result)
+        return result;
+    return do_ncmp_float(aTHX_ out, SvNV_nomg(left), SvNV_nomg(right));
+}
+
+// Define the "use integer" comparison wrappers for NAME:
+//
+// do_i_NAME() - supports magic and overloading
+// do_i_NAME_noov() - for "no overloading;"
+//
+// adapted from pp_i_lt etc, these don't numify references
+#define DEFINE_INT_COMPARE(name, method, op) \
+static inline SV * \
+do_i_##name(pTHX_ SV *left, SV *right, int amagic_flags) { \
+    assert_AMAGIC(); \
+    SV *result = my_try_amagic_bin(aTHX_ NULL, &left, &right, method, \
+                                   amagic_flags, false); \
+    if (result) \
+        return result; \
+    return boolSV(SvIV_nomg(left) op SvIV_nomg(right)); \
+} \
+\
+static inline SV * \
+do_i_##name##_noov(pTHX_ SV *left, SV *right) { \
+    assert_NO_AMAGIC(); \
+    SvGETMAGIC(left); \
+    if (left != right) \
+        SvGETMAGIC(right); \
+    return boolSV(SvIV_nomg(left) op SvIV_nomg(right)); \
+}
+
+DEFINE_INT_COMPARE(lt, lt_amg, <)
+DEFINE_INT_COMPARE(gt, gt_amg, >)
+DEFINE_INT_COMPARE(le, le_amg, <=)
+DEFINE_INT_COMPARE(ge, ge_amg, >=)
+DEFINE_INT_COMPARE(eq, eq_amg, ==)
+DEFINE_INT_COMPARE(ne, ne_amg, !=)
+
+// "use integer" <=> with magic and overloading
+static inline SV *
+do_i_ncmp(pTHX_ SV *out, SV *left, SV *right, int amagic_flags) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, ncmp_amg,
+                                   amagic_flags, false);
+    if (result)
+        return result;
+    IV il = SvIV_nomg(left);
+    IV ir = SvIV_nomg(right);
+    fast_sv_setiv(aTHX_ out, (il > ir) - (il < ir));
+    return out;
+}
+
+// "use integer" <=> for "no overloading;"
+static inline SV *
+do_i_ncmp_noov(pTHX_ SV *out, SV *left, SV *right) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(left);
+    if (left != right)
+        SvGETMAGIC(right);
+    IV il = SvIV_nomg(left);
+    IV ir = SvIV_nomg(right);
+    fast_sv_setiv(aTHX_ out, (il > ir) - (il < ir));
+    return out;
+}
+
+// "use integer" <=> on raw IVs
+static inline IV
+do_i_ncmp_raw(IV left, IV right) {
+    return (left > right) - (left < right);
+}
+
+// "use integer" arithmetic on IVs, adapted from pp_i_add etc.
+// These are used directly for raw IV values without overloading.
+//
+// The arithmetic is done as UVs so overflow wraps rather than being
+// undefined.
+static inline IV
+do_i_add_raw(pTHX_ IV left, IV right) {
+    PERL_UNUSED_CONTEXT;
+    return (IV)((UV)left + (UV)right);
+}
+
+static inline IV
+do_i_subtract_raw(pTHX_ IV left, IV right) {
+    PERL_UNUSED_CONTEXT;
+    return (IV)((UV)left - (UV)right);
+}
+
+static inline IV
+do_i_multiply_raw(pTHX_ IV left, IV right) {
+    PERL_UNUSED_CONTEXT;
+    return (IV)((UV)left * (UV)right);
+}
+
+static inline IV
+do_i_divide_raw(pTHX_ IV left, IV right) {
+    if (right == 0)
+        croak("Illegal division by zero");
+    /* avoid FPE_INTOVF on some platforms when left is IV_MIN */
+    if (right == -1)
+        return (IV)-(UV)left;
+    return left / right;
+}
+
+static inline IV
+do_i_modulo_raw(pTHX_ IV left, IV right) {
+    if (right == 0)
+        croak("Illegal modulus zero");
+    /* avoid FPE_INTOVF on some platforms when left is IV_MIN */
+    if (right == -1)
+        return 0;
+    return left % right;
+}
+
+static inline IV
+do_i_negate_raw(pTHX_ IV value) {
+    PERL_UNUSED_CONTEXT;
+    return (IV)-(UV)value;
+}
+
+// Define the "use integer" arithmetic wrappers for NAME:
+//
+// do_i_NAME() - supports magic and overloading
+// do_i_NAME_noov() - for "no overloading;"
+//
+// As with the comparisons these don't numify references.  The right
+// operand is fetched first, as pp_i_add etc do.
+#define DEFINE_INT_BINOP(name, method) \
+static inline SV * \
+do_i_##name(pTHX_ SV *out, SV *left, SV *right, int amagic_flags, \
+            bool mutator) { \
+    assert_AMAGIC(); \
+    SV *result = my_try_amagic_bin(aTHX_ out, &left, &right, method, \
+                                   amagic_flags, mutator); \
+    if (result) \
+        return result; \
+    IV ir = SvIV_nomg(right); \
+    fast_sv_setiv(aTHX_ out, do_i_##name##_raw(aTHX_ SvIV_nomg(left), ir)); \
+    return out; \
+} \
+\
+static inline void \
+do_i_##name##_noov(pTHX_ SV *out, SV *left, SV *right) { \
+    assert_NO_AMAGIC(); \
+    SvGETMAGIC(left); \
+    if (left != right) \
+        SvGETMAGIC(right); \
+    IV ir = SvIV_nomg(right); \
+    fast_sv_setiv(aTHX_ out, do_i_##name##_raw(aTHX_ SvIV_nomg(left), ir)); \
+}
+
+DEFINE_INT_BINOP(add, add_amg)
+DEFINE_INT_BINOP(subtract, subtr_amg)
+DEFINE_INT_BINOP(multiply, mult_amg)
+DEFINE_INT_BINOP(divide, div_amg)
+DEFINE_INT_BINOP(modulo, modulo_amg)
+
+// "use integer" negation with magic and overloading, strings are
+// negated as strings as with pp_i_negate
+static inline SV *
+do_i_negate(pTHX_ SV *out, SV *sv) {
+    assert_AMAGIC();
+    SV *result = my_try_amagic_un(aTHX_ &sv, neg_amg, 0);
+    if (result)
+        return result;
+    if (SvPOKp(sv) && my_negate_string(aTHX_ out, sv))
+        return out;
+    fast_sv_setiv(aTHX_ out, do_i_negate_raw(aTHX_ SvIV_nomg(sv)));
+    return out;
+}
+
+// "use integer" negation for "no overloading;"
+static inline void
+do_i_negate_noov(pTHX_ SV *out, SV *sv) {
+    assert_NO_AMAGIC();
+    SvGETMAGIC(sv);
+    if (SvPOKp(sv) && my_negate_string(aTHX_ out, sv))
+        return;
+    fast_sv_setiv(aTHX_ out, do_i_negate_raw(aTHX_ SvIV_nomg(sv)));
+}
+
+// array element fetches for rvalues, adapted from pp_aelemfast and
+// pp_aelem
+//
+// Elements of a plain array within its bounds are read directly from
+// AvARRAY(), anything else, including negative indexes and tied or
+// other RMAGICAL arrays, goes through av_fetch().  The element itself
+// is returned, as the ops push it, or &PL_sv_undef if it doesn't
+// exist.
+static inline SV *
+do_aelem(pTHX_ AV *av, SSize_t key) {
+    /* a failed symbolic dereference leaves undef */
+    if (UNLIKELY(SvTYPE(av) != SVt_PVAV))
+        return &PL_sv_undef;
+    if (LIKELY(!SvRMAGICAL(av) && key >= 0 && key <= AvFILLp(av))) {
+        SV *sv = AvARRAY(av)[key];
+        return sv ? sv : &PL_sv_undef;
+    }
+    SV **svp = av_fetch(av, key, 0);
+    SV *sv = svp ? *svp : &PL_sv_undef;
+    if (SvRMAGICAL(av) && SvGMAGICAL(sv))
+        mg_get(sv);
+    return sv;
+}
+
+// array element fetch with an SV index, as pp_aelem
+static inline SV *
+do_aelem_sv(pTHX_ AV *av, SV *elemsv) {
+    IV elem = SvIV(elemsv);
+    if (UNLIKELY(SvROK(elemsv) && !SvGAMAGIC(elemsv) && ckWARN(WARN_MISC)))
+        Perl_warner(aTHX_ packWARN(WARN_MISC),
+                    "Use of reference \"%" SVf "\" as array index",
+                    SVfARG(elemsv));
+    return do_aelem(aTHX_ av, elem);
+}
+
+// $ref->[...] and $ref->{...} autovivify $ref, adapted from
+// Perl_vivify_ref()
+static SV *
+my_vivify_ref(pTHX_ SV *sv, svtype type) {
+    SvGETMAGIC(sv);
+    if (!SvOK(sv)) {
+        if (SvREADONLY(sv))
+            croak_no_modify();
+        sv_setrv_noinc(sv, type == SVt_PVAV ? (SV *)newAV() : (SV *)newHV());
+        SvSETMAGIC(sv);
+        SvGETMAGIC(sv);
+    }
+    if (SvGMAGICAL(sv)) {
+        /* don't repeat the magic for the dereference */
+        SV *msv = sv_newmortal();
+        sv_setsv_nomg(msv, sv);
+        return msv;
+    }
+    return sv;
+}
+
+static inline SV *
+do_vivify_av(pTHX_ SV *sv) {
+    return my_vivify_ref(aTHX_ sv, SVt_PVAV);
+}
+
+static inline SV *
+do_vivify_hv(pTHX_ SV *sv) {
+    return my_vivify_ref(aTHX_ sv, SVt_PVHV);
+}
+
+// @{...} or %{...} for an element fetch, op is the OP_RV2AV or
+// OP_RV2HV
+//
+// References and globs are handled here, anything else (magic,
+// overloading, symbolic references and errors) is left to the op
+// itself.
+static SV *
+my_rv2xv(pTHX_ SV *sv, OP *op, svtype type) {
+    if (!SvGMAGICAL(sv)) {
+        if (SvROK(sv)) {
+            if (!SvAMAGIC(sv) && SvTYPE(SvRV(sv)) == type)
+                return SvRV(sv);
+        }
+        else if (isGV_with_GP(sv)) {
+            return type == SVt_PVAV ? (SV *)GvAVn((GV *)sv)
+                                    : (SV *)GvHVn((GV *)sv);
+        }
+    }
+    OP *saved = PL_op;
+    rpp_xpush_1(sv);
+    PL_op = op;
+    op->op_ppaddr(aTHX);
+    PL_op = saved;
+    SV *xv = *PL_stack_sp;
+    rpp_popfree_1();
+    return xv;
+}
+
+static inline AV *
+do_rv2av(pTHX_ SV *sv, OP *op) {
+    return (AV *)my_rv2xv(aTHX_ sv, op, SVt_PVAV);
+}
+
+static inline HV *
+do_rv2hv(pTHX_ SV *sv, OP *op) {
+    return (HV *)my_rv2xv(aTHX_ sv, op, SVt_PVHV);
+}
+
+// hash element fetch for rvalues, adapted from pp_helem
+//
+// hash is the precomputed hash of a constant key, or 0 to have perl
+// hash the key.
+static inline SV *
+do_helem(pTHX_ HV *hv, SV *keysv, U32 hash) {
+    /* a failed symbolic dereference leaves undef */
+    if (UNLIKELY(SvTYPE(hv) != SVt_PVHV))
+        return &PL_sv_undef;
+    HE *he = (HE *)hv_common(hv, keysv, NULL, 0, 0, 0, NULL, hash);
+    SV *sv = he && HeVAL(he) ? HeVAL(he) : &PL_sv_undef;
+    if (SvRMAGICAL(hv) && SvGMAGICAL(sv))
+        mg_get(sv);
+    return sv;
+}
+
+// the SV for an OP_MULTIDEREF aux item, a GV or a constant key,
+// these are moved to the pad on threaded builds
+static inline SV *
+md_item_sv(pTHX_ const OP *op, size_t index) {
+    const UNOP_AUX_item *item = cUNOP_AUXx(op)->op_aux + index;
+#ifdef USE_ITHREADS
+    return PAD_SVl(item->pad_offset);
+#else
+    PERL_UNUSED_CONTEXT;
+    return item->sv;
+#endif
+}
+
+// symbolic references for OP_MULTIDEREF, adapted from the static
+// S_softref2xv_lite() in pp_hot.c, op is the multideref
+static GV *
+my_md_softref2xv(pTHX_ SV *sv, const char *what, svtype type,
+                 const OP *op) {
+    if (op->op_private & HINT_STRICT_REFS) {
+        if (SvOK(sv))
+            Perl_die(aTHX_ PL_no_symref_sv, sv,
+                     (SvPOKp(sv) && SvCUR(sv) > 32 ? "..." : ""), what);
+        else
+            Perl_die(aTHX_ PL_no_usym, what);
+    }
+    if (!SvOK(sv))
+        Perl_die(aTHX_ PL_no_usym, what);
+    return gv_fetchsv_nomg(sv, GV_ADD, type);
+}
+
+// the array or hash for an OP_MULTIDEREF element action, adapted
+// from pp_multideref
+static SV *
+my_md_rv2xv(pTHX_ SV *sv, const OP *op, svtype type) {
+    const char *what = type == SVt_PVAV ? "an ARRAY" : "a HASH";
+    if (SvROK(sv)) {
+        if (UNLIKELY(SvAMAGIC(sv)))
+            sv = amagic_deref_call(sv, type == SVt_PVAV ? to_av_amg
+                                                        : to_hv_amg);
+        sv = SvRV(sv);
+        if (UNLIKELY(SvTYPE(sv) != type))
+            Perl_die(aTHX_ "Not %s reference", what);
+    }
+    else if (SvTYPE(sv) != type) {
+        if (!isGV_with_GP(sv))
+            sv = (SV *)my_md_softref2xv(aTHX_ sv, what, type, op);
+        sv = type == SVt_PVAV ? (SV *)GvAVn((GV *)sv)
+                              : (SV *)GvHVn((GV *)sv);
+    }
+    return sv;
+}
+
+static inline AV *
+do_md_rv2av(pTHX_ SV *sv, const OP *op) {
+    return (AV *)my_md_rv2xv(aTHX_ sv, op, SVt_PVAV);
+}
+
+static inline HV *
+do_md_rv2hv(pTHX_ SV *sv, const OP *op) {
+    return (HV *)my_md_rv2xv(aTHX_ sv, op, SVt_PVHV);
+}
+
+// an array index from a variable for OP_MULTIDEREF
+static inline IV
+do_md_index(pTHX_ SV *elemsv) {
+    if (UNLIKELY(SvROK(elemsv) && !SvGAMAGIC(elemsv) && ckWARN(WARN_MISC)))
+        Perl_warner(aTHX_ packWARN(WARN_MISC),
+                    "Use of reference \"%" SVf "\" as array index",
+                    SVfARG(elemsv));
+    return SvIV(elemsv);
+}
+
+// an array element an OP_MULTIDEREF dereferences further, as with
+// pp_multideref these are created if they don't exist
+static SV *
+do_md_aelem_lval(pTHX_ AV *av, IV elem) {
+    SV **svp = av_fetch(av, elem, 1);
+    SV *sv;
+    if (!svp || !(sv = *svp))
+        Perl_die(aTHX_ PL_no_aelem, (int)elem);
+    return sv;
+}
+
+// a hash element an OP_MULTIDEREF dereferences further
+static SV *
+do_md_helem_lval(pTHX_ HV *hv, SV *keysv, U32 hash) {
+    HE *he = (HE *)hv_common(hv, keysv, NULL, 0, 0, HV_FETCH_LVALUE, NULL,
+                             hash);
+    SV *sv;
+    if (!he || !(sv = HeVAL(he)) || sv == &PL_sv_undef)
+        Perl_die(aTHX_ PL_no_helem_sv, SVfARG(keysv));
+    return sv;
+}
+
+// scalar assignment to a lexical, the parts of pp_sassign that
+// apply when the target is a pad scalar
+static inline void
+do_sassign(pTHX_ SV *targ, SV *val) {
+    if (UNLIKELY(TAINT_get) && !SvTAINTED(val))
+        TAINT_NOT;
+    SvSetMagicSV(targ, val);
+}
+
+// a value for a list assignment that might be one of the variables
+// assigned to, copied unless it's a temporary nothing else can see,
+// adapted from S_aassign_copy_common()
+static inline SV *
+do_aassign_copy(pTHX_ SV *sv) {
+    if (SvPADTMP(sv) ||
+        (SvTEMP(sv) && SvREFCNT(sv) == 1 && !SvMAGICAL(sv)))
+        return sv;
+    return sv_mortalcopy(sv);
+}
+
+// SV flags that prevent the IV fast path for ++ and --, adapted
+// from pp_preinc
+#define INCDEC_SLOW_FLAGS \
+    (SVf_THINKFIRST|SVs_GMG|SVf_IVisUV|SVf_IOK|SVf_NOK|SVf_POK| \
+     SVp_NOK|SVp_POK|SVf_ROK)
+
+// ++$x, adapted from pp_preinc, the result is sv itself
+static inline void
+do_preinc(pTHX_ SV *sv) {
+    if (LIKELY((sv->sv_flags & INCDEC_SLOW_FLAGS) == SVf_IOK) &&
+        SvIVX(sv) != IV_MAX)
+        SvIV_set(sv, SvIVX(sv) + 1);
+    else // the PERL_PRESERVE_IVUV and hard cases
+        sv_inc(sv);
+    SvSETMAGIC(sv);
+}
+
+// --$x, adapted from pp_predec
+static inline void
+do_predec(pTHX_ SV *sv) {
+    if (LIKELY((sv->sv_flags & INCDEC_SLOW_FLAGS) == SVf_IOK) &&
+        SvIVX(sv) != IV_MIN)
+        SvIV_set(sv, SvIVX(sv) - 1);
+    else
+        sv_dec(sv);
+    SvSETMAGIC(sv);
+}
+
+// $x++ and $x-- other than for simple integers, adapted from
+// S_postincdec_common
+static SV *
+my_postincdec(pTHX_ SV *targ, SV *sv, bool inc) {
+    if (SvROK(sv))
+        targ = sv_newmortal();
+    sv_setsv(targ, sv);
+    if (inc)
+        sv_inc_nomg(sv);
+    else
+        sv_dec_nomg(sv);
+    SvSETMAGIC(sv);
+    // undef++ is 0
+    if (inc && !SvOK(targ))
+        sv_setiv(targ, 0);
+    return targ;
+}
+
+// $x++, adapted from pp_postinc, the result is the old value in
+// targ, or a new mortal
+static inline SV *
+do_postinc(pTHX_ SV *targ, SV *sv) {
+    if (LIKELY((sv->sv_flags & INCDEC_SLOW_FLAGS) == SVf_IOK) &&
+        SvIVX(sv) != IV_MAX) {
+        IV iv = SvIVX(sv);
+        SvIV_set(sv, iv + 1);
+        fast_sv_setiv(aTHX_ targ, iv); // sv not GMG, so can't be tainted
+        return targ;
+    }
+    return my_postincdec(aTHX_ targ, sv, true);
+}
+
+// $x--, adapted from pp_postdec
+static inline SV *
+do_postdec(pTHX_ SV *targ, SV *sv) {
+    if (LIKELY((sv->sv_flags & INCDEC_SLOW_FLAGS) == SVf_IOK) &&
+        SvIVX(sv) != IV_MIN) {
+        IV iv = SvIVX(sv);
+        SvIV_set(sv, iv - 1);
+        fast_sv_setiv(aTHX_ targ, iv);
+        return targ;
+    }
+    return my_postincdec(aTHX_ targ, sv, false);
+}
+
+// the test for // and //=, adapted from pp_defined
+static inline bool
+do_defined(pTHX_ SV *sv) {
+    if (!sv || !SvANY(sv))
+        return false;
+    SvGETMAGIC(sv);
+    return SvOK(sv);
+}
+
+// SV flags that prevent the IV specialisation of a fragment reading
+// the IV directly, any string or float value, magic or references
+#define GUARD_IV_READ_FLAGS \
+    (SVs_GMG|SVf_IVisUV|SVf_IOK|SVf_NOK|SVf_POK|SVf_ROK)
+
+// SV flags that prevent it storing an IV without running other code,
+// such as STORE for a tied variable or DESTROY for a referenced object
+#define GUARD_IV_STORE_FLAGS \
+    (SVf_READONLY|SVf_PROTECT|SVf_ROK|SVs_GMG|SVs_SMG|SVs_RMG)
+
+// checked on entry to a fragment, a plain IV perl's arithmetic would
+// use the IV of
+static inline bool
+guard_iv_read(SV *sv) {
+    return (SvFLAGS(sv) & GUARD_IV_READ_FLAGS) == SVf_IOK;
+}
+
+// checked on entry to a fragment, a variable that fast_sv_setiv() can
+// store to without side effects
+static inline bool
+guard_iv_store(SV *sv) {
+    return (SvFLAGS(sv) & GUARD_IV_STORE_FLAGS) == 0;
+}
+
+// SV flags that prevent a loop reading the NV of a variable once
+// before it starts, any string value, magic or reference
+#define GUARD_INVARIANT_NV_FLAGS (SVs_GMG|SVf_NOK|SVf_POK|SVf_ROK)
+
+// checked before a loop that doesn't store to sv, a plain NV whose
+// NV and IV perl would use can be read once before the loop.  Only
+// the pad refers to it, so no other code can change it either.
+static inline bool
+guard_invariant_nv(SV *sv) {
+    return (SvFLAGS(sv) & GUARD_INVARIANT_NV_FLAGS) == SVf_NOK &&
+           SvREFCNT(sv) == 1;
+}
+
+// as guard_invariant_nv() for a plain IV
+static inline bool
+guard_invariant_iv(SV *sv) {
+    return guard_iv_read(sv) && SvREFCNT(sv) == 1;
+}
+
 /* API END */
@@ -0,0 +1,133 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# the IV specialisation of fragments, guarded by a check on entry
+
+sub mul_add ($x, $y, $z) {
+    use Faster::Maths::CC;
+    my $r = $x * $y + $z;
+    return $r;
+}
+
+is(mul_add(3, 4, 5), 17, "plain integers");
+is(mul_add("3", 4, "5"), 17, "strings use the generic code");
+is(mul_add(1.5, 2, 1), 4, "floats use the generic code");
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    is(mul_add(-3, 4, undef), -12, "undef uses the generic code");
+    is(@warn, 1, "and warns");
+}
+
+my $max = ~0 >> 1;
+my $min = -$max - 1;
+{
+    no warnings "imprecision";
+    my $want = $max * 2 + 1;
+    is(mul_add($max, 2, 1), $want, "overflow falls back to the generic code");
+    $want = $max * 1 + 1;
+    is(mul_add($max, 1, 1), $want, "overflow on the second op");
+    isnt(mul_add($max, 1, 1), $min, "not wrapped");
+}
+
+sub neg_cmp ($x, $y) {
+    use Faster::Maths::CC;
+    return (-$x <=> abs($y)) . "";
+}
+
+is(neg_cmp(3, -5), -1, "negate, abs and <=>");
+is(neg_cmp(-7, 5), 1, "negate, abs and <=> again");
+{
+    my $want = (-$min <=> abs(1)) . "";
+    is(neg_cmp($min, 1), $want, "negating IV_MIN");
+}
+
+sub accumulate ($s, $i) {
+    use Faster::Maths::CC;
+    $s += $i * 3 - 1;
+    return $s;
+}
+
+is(accumulate(10, 4), 21, "assignment operator");
+is(accumulate(10.5, 4), 21.5, "assignment operator to a float");
+
+sub store_then_mul ($x, $y) {
+    use Faster::Maths::CC;
+    my $t;
+    my $r = ($t = $x + 1) * $y;
+    return [ $t, $r ];
+}
+
+{
+    no warnings "imprecision";
+    my $want = ($max - 1 + 1) * 2;
+    is(store_then_mul($max - 1, 2), [ $max, $want ],
+       "overflow after a store");
+}
+
+{
+    package CountStore;
+    sub TIESCALAR ($class) { bless { stores => 0 }, $class }
+    sub FETCH ($self) { $self->{value} }
+    sub STORE ($self, $v) { ++$self->{stores}; $self->{value} = $v }
+}
+
+{
+    tie my $t, "CountStore";
+    my ($x, $y) = (2, 3);
+    {
+        use Faster::Maths::CC;
+        $t = $x * $y + 1;
+    }
+    is($t, 7, "stored to a tied variable");
+    is(tied($t)->{stores}, 1, "stored once");
+}
+
+{
+    package Num;
+    use overload
+      "*" => sub ($x, $y, $swap) { Num->new($x->{v} * (ref $y ? $y->{v} : $y)) },
+      "+" => sub ($x, $y, $swap) { Num->new($x->{v} + (ref $y ? $y->{v} : $y)) };
+    sub new ($class, $v) { bless { v => $v }, $class }
+}
+
+is(mul_add(Num->new(2), 3, 4)->{v}, 10, "objects use the generic code");
+
+sub int_ops ($x, $y) {
+    use Faster::Maths::CC;
+    use integer;
+    my $r = $x * $y + $x / $y - $x % $y;
+    return $r;
+}
+
+is(int_ops(17, 5), 86, "use integer");
+{
+    use integer;
+    my $want = $max * 2 + $max / 2 - $max % 2;
+    is(int_ops($max, 2), $want, "use integer wraps");
+}
+
+# "use integer" so the stores aren't followed by ops that may need
+# the generic code
+sub alias_store ($y) {
+    use Faster::Maths::CC;
+    use integer;
+    my $z;
+    for my $x ($y) {
+        # $x is $y, so the store changes what the second $y reads
+        $z = ($x = $y + 1) * 0 + $y + 1;
+    }
+    return [ $y, $z ];
+}
+
+is(alias_store(1), [ 2, 3 ], "store to an alias of a variable read");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/if \(guard_iv_read\(loc\d+\)/, "generated the guard");
+    like($code, qr/guard_iv_store\(loc\d+\)/, "generated the store guard");
+    like($code, qr/goto generic;/, "generated the fallback");
+}
+
+done_testing;
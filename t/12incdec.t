@@ -0,0 +1,111 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# ++, -- and assignment operators within fragments
+
+sub pre_post ($i, $j) {
+    use Faster::Maths::CC;
+    my $x = $i++ * 2 + ++$j;
+    my $y = $i-- * 3 - --$j;
+    return [ $x, $y, $i, $j ];
+}
+
+is(pre_post(2, 5), [ 10, 4, 2, 5 ], "prefix and postfix");
+
+sub inc_one ($x) {
+    use Faster::Maths::CC;
+    my $old = $x++;
+    return [ $old, $x ];
+}
+
+is(inc_one(1.5), [ 1.5, 2.5 ], "NV increment");
+is(inc_one("aa"), [ "aa", "ab" ], "magic string increment");
+is(inc_one("Az"), [ "Az", "Ba" ], "magic string carry");
+is(inc_one(undef), [ 0, 1 ], "undef increments to 1");
+
+sub dec_one ($x) {
+    use Faster::Maths::CC;
+    no warnings "imprecision";
+    my $old = $x--;
+    return [ $old, $x ];
+}
+
+{
+    my $max = ~0 >> 1;
+    my $min = -$max - 1;
+    my $x = $max;
+    $x++;
+    is(inc_one($max), [ $max, $x ], "increment past IV_MAX");
+    $x = $min;
+    {
+        no warnings "imprecision";
+        $x--;
+    }
+    is(dec_one($min), [ $min, $x ], "decrement past IV_MIN");
+}
+
+{
+    ok(!eval {
+        for my $c (1) {
+            use Faster::Maths::CC;
+            my $x = $c++ * 2 + 1;
+        }
+        1
+    }, "modifying a constant");
+    like($@, qr/Modification of a read-only value/, "perl's error");
+}
+
+{
+    package Counter;
+    use overload
+      "++" => sub ($self, @) { $self->{v} += 10; $self },
+      "0+" => sub ($self, @) { $self->{v} },
+      "=" => sub ($self, @) { Counter->new($self->{v}) },
+      fallback => 1;
+    sub new ($class, $v) { bless { v => $v }, $class }
+}
+
+{
+    my $c = Counter->new(1);
+    my $x = do {
+        use Faster::Maths::CC;
+        ++$c * 2 + 1;
+    };
+    is($x, 23, "overloaded ++");
+    is($c->{v}, 11, "object incremented");
+}
+
+sub count_down ($n) {
+    use Faster::Maths::CC;
+    my $s = 0;
+    while ($n > 0) {
+        $s += $n * 2;
+        $s -= 1;
+        $n--;
+    }
+    return $s;
+}
+
+is(count_down(4), 16, "loop with -- and assignment operators");
+
+sub int_ops ($n) {
+    use Faster::Maths::CC;
+    use integer;
+    my ($i, $s) = (0, 0);
+    while ($i < $n) {
+        $s += $i * 3;
+        $i++;
+    }
+    return $s;
+}
+
+is(int_ops(4), 18, "use integer ++ and +=");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/do_postinc\(aTHX_ loc\d+, loc\d+\)/, "generated postfix");
+    like($code, qr/do_preinc\(aTHX_ loc\d+\)/, "generated prefix");
+}
+
+done_testing;
@@ -0,0 +1,93 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(mode_subs);
+
+# compare the results of the compiled modulus, power and "use
+# integer" ops against perl's own for the various modes
+
+# set up at BEGIN time so the subs are compiled before CHECK
+my @subs;
+BEGIN {
+    my @modes = (qw(default noov ovfloat float integer), "integer noov");
+    # the "+ 0"s make enough ops for a fragment
+    @subs = mode_subs(<<'EOS', @modes);
+    my ($x, $y) = @_;
+    my $z = $x;
+    $z **= $y + 0;
+    my $w = $x % $y * 1;
+    return [ $x % $y + 0, $x ** $y + 0, $x * $y - $x / $y, -$x + 0,
+             $z, $w ];
+EOS
+}
+
+my @values =
+  (
+    [ 7, 3 ], [ -7, 3 ], [ 7, -3 ], [ -7, -3 ], [ 2, 10 ], [ 3, 5 ],
+    [ 10.5, 3 ], [ "12", "5" ], [ 9, 2 ], [ 1, 1 ], [ -2, 63 ],
+    [ 2.7, 1e30 ], [ -2.7, 1e30 ], [ 1e30, 7.5 ],
+  );
+
+for my $mode (@subs) {
+    my ($name, $fmc, $perl) = @$mode;
+    for my $pair (@values) {
+        is($fmc->(@$pair), $perl->(@$pair), "$name: @$pair");
+    }
+    # "+float" loses the low bits
+    unless ($name =~ /float/) {
+        is($fmc->(~0, 7), $perl->(~0, 7), "$name: large UV");
+        is($fmc->(-9**9**9, 3), $perl->(-9**9**9, 3), "$name: -Inf");
+    }
+    ok(!eval { $fmc->(1, 0); 1 }, "$name: zero dies");
+    like($@, qr/^Illegal (?:modulus|division by) zero/,
+         "$name: zero message");
+}
+
+{
+    use Faster::Maths::CC;
+    use integer;
+    my ($x, $y) = ("foo", 2);
+    is(-$x . ($y * $y - $y), "-foo2", "integer negation of a string");
+    ($x, $y) = (~0 >> 1, 2);
+    is($x * $y + $y, 0, "integer overflow wraps");
+    $x = -$x - 1;
+    is($x / -1 + 0, $x, "IV_MIN / -1");
+    is($x % -1 + 0, 0, "IV_MIN % -1");
+}
+
+{
+    package Order;
+    sub TIESCALAR ($class, $name, $log) { bless [ $name, $log ], $class }
+    sub FETCH ($self) { push $self->[1]->@*, $self->[0]; 3 }
+}
+
+{
+    my @log;
+    tie my $l, "Order", "left", \@log;
+    tie my $r, "Order", "right", \@log;
+    my ($i, $f) = do {
+        use Faster::Maths::CC;
+        use integer;
+        no overloading;
+        ($l * $r + 1, $l - $r - 1);
+    };
+    is([ $i, $f ], [ 10, -1 ], "integer ops on tied operands");
+    is(\@log, [ qw(left right) x 2 ], "integer operands read left first");
+    @log = ();
+    my $g = do {
+        use Faster::Maths::CC "+float";
+        no overloading;
+        $l % $r + $l ** $r;
+    };
+    is($g, 27, "float ops on tied operands");
+    is(\@log, [ qw(left right) x 2 ], "float operands read left first");
+}
+
+ok(grep($_->[0] =~ /do_modulo/, @Faster::Maths::CC::collection),
+   "we compiled a modulus");
+ok(grep($_->[0] =~ /IV iv\d+ = do_i_add_raw\(/,
+        @Faster::Maths::CC::collection),
+   "we compiled raw integer arithmetic");
+
+done_testing;
@@ -0,0 +1,62 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(mode_subs);
+
+# compare the results of the compiled comparison ops against perl's
+# own for the various modes
+
+# set up at BEGIN time so the subs are compiled before CHECK
+my @subs;
+BEGIN {
+    my @modes = (qw(default noov ovfloat float integer), "integer noov");
+    # the "+ 0"s make enough ops for a fragment
+    @subs = mode_subs(<<'EOS', @modes);
+    my ($x, $y) = @_;
+    return [ $x + 0 < $y + 0, $x + 0 > $y + 0, $x + 0 <= $y + 0,
+             $x + 0 >= $y + 0, $x + 0 == $y + 0, $x + 0 != $y + 0,
+             $x + 0 <=> $y + 0 ];
+EOS
+}
+
+my @values =
+  (
+    [ 1, 2 ], [ 2, 1 ], [ 2, 2 ], [ -1, ~0 ], [ ~0, -1 ], [ 0.5, 0.25 ], [ 0.25, 0.25 ], [ "10", "9" ], [ " 3 ", 3 ],
+    [ 9**9**9, 1 ], [ -9**9**9, 9**9**9 ],
+  );
+
+for my $mode (@subs) {
+    my ($name, $fmc, $perl) = @$mode;
+    for my $pair (@values) {
+        no warnings "numeric";
+        is($fmc->(@$pair), $perl->(@$pair), "$name: @$pair");
+    }
+    # "+float" loses the low bits
+    is($fmc->(~0, ~0 - 1), $perl->(~0, ~0 - 1), "$name: large UVs")
+      unless $name =~ /float/;
+}
+
+{
+    # NaN only makes sense for the non-integer modes
+    my $nan = 9**9**9 / 9**9**9;
+    for my $mode (@subs[0..3]) {
+        my ($name, $fmc, $perl) = @$mode;
+        is($fmc->($nan, 1), $perl->($nan, 1), "$name: NaN, 1");
+        is($fmc->(1, $nan), $perl->(1, $nan), "$name: 1, NaN");
+    }
+}
+
+{
+    # compare whole expressions
+    use Faster::Maths::CC;
+    my ($zr, $zi) = (0.125, 0.5);
+    ok($zr*$zr + $zi*$zi < 2*2, "julia condition true");
+    ($zr, $zi) = (2, 1.5);
+    ok(!($zr*$zr + $zi*$zi < 2*2), "julia condition false");
+}
+
+ok(grep($_->[0] =~ /do_lt\(/, @Faster::Maths::CC::collection),
+   "we compiled a comparison");
+
+done_testing;
@@ -0,0 +1,139 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# &&, ||, //, their assignment forms and ?: within fragments
+
+my $all = \@Faster::Maths::CC::collection;
+
+sub my_abs ($x) {
+    use Faster::Maths::CC;
+    my $r = $x > 0 ? $x : -$x;
+    return $r;
+}
+
+is(my_abs(3), 3, "?: true branch");
+is(my_abs(-2.5), 2.5, "?: false branch");
+{
+    my @frags = grep $_->[3] eq __FILE__ && $_->[2] == 11, @$all;
+    is(@frags, 1, "one fragment for the ?: statement")
+      or diag map $_->[0], @frags;
+}
+
+sub and_mul ($x, $y, $z) {
+    use Faster::Maths::CC;
+    my $r = $x && $y * $z;
+    return $r;
+}
+
+is(and_mul(2, 3, 4), 12, "&& true");
+is(and_mul(0, 3, 4), 0, "&& false");
+is(and_mul("", 3, 4), "", "&& false gives the left value");
+
+sub or_mul ($x, $y) {
+    use Faster::Maths::CC;
+    return ($x || $y * 2) . "";
+}
+
+is(or_mul("abc", 3), "abc", "|| true gives the left value");
+is(or_mul(0, 3), 6, "|| false");
+
+sub dor_add ($x, $y) {
+    use Faster::Maths::CC;
+    my $r = $x // $y + 1;
+    return $r;
+}
+
+is(dor_add(undef, 2), 3, "// undefined");
+is(dor_add(0, 2), 0, "// defined");
+
+sub defaults ($x, $y, $z) {
+    use Faster::Maths::CC;
+    $x ||= $y * 2;
+    $y &&= $y + 10;
+    $z //= $x + $y;
+    return [ $x, $y, $z ];
+}
+
+is(defaults(0, 1, undef), [ 2, 11, 13 ], "||=, &&=, //= assigning");
+is(defaults(5, 0, 7), [ 5, 0, 7 ], "||=, &&=, //= not assigning");
+
+sub sign ($x) {
+    use Faster::Maths::CC;
+    return $x < 0 ? -1 : $x > 0 ? 1 : $x * 0;
+}
+
+is([ map sign($_), -3, 0, 4 ], [ -1, 0, 1 ], "nested ?:");
+
+sub pos_sum ($r) {
+    use Faster::Maths::CC;
+    my ($i, $s) = (0, 0);
+    while ($i < 4) {
+        $r->[$i] > 0 and $s = $s + $r->[$i];
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(pos_sum([ 1, -2, 3, -4 ]), 4, "&& in void context in a loop");
+
+sub diff ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    return $x > $y ? $x - $y : $y - $x;
+}
+
+sub total_diff ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    return diff($x, $y) + diff($y, 1) * 2;
+}
+
+is(total_diff(2, 5), 11, "raw results merged");
+like(join("", @Faster::Maths::CC::leaves), qr/if \(/,
+     "leaf sub with a conditional");
+
+sub count_steps ($n, $limit) {
+    use Faster::Maths::CC;
+    my $i = 0;
+    while ($i < $n and $i < 100) {
+        $i = $i + 1;
+        $i < $limit or return -1;
+    }
+    return $i;
+}
+
+is(count_steps(5, 10), 5, "loop finishes");
+is(count_steps(5, 3), -1, "return from a branch in a loop");
+{
+    my @frags = grep $_->[3] eq __FILE__ && $_->[2] >= 96 && $_->[2] <= 104,
+      @$all;
+    is(@frags, 1, "one fragment for count_steps()")
+      or diag map $_->[0], @frags;
+}
+
+{
+    package Truth;
+    use overload
+      bool => sub ($self, @) { ++$self->{tests}; $self->{v} },
+      fallback => 1;
+    sub new ($class, $v) { bless { v => $v, tests => 0 }, $class }
+}
+
+{
+    my $t = Truth->new(1);
+    my $x = do {
+        use Faster::Maths::CC;
+        ($t && 1) * 2 + 3;
+    };
+    is($x, 5, "overloaded bool");
+    is($t->{tests}, 1, "tested once");
+}
+
+{
+    my $code = join "", map $_->[0], @$all;
+    like($code, qr/do_defined\(aTHX_ loc\d+\)/, "generated // test");
+    like($code, qr/else \{/, "generated ?: branches");
+}
+
+done_testing;
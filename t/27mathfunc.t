@@ -0,0 +1,71 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(mode_subs);
+
+# compare the results of the compiled numeric functions against
+# perl's own for the various modes
+
+# set up at BEGIN time so the subs are compiled before CHECK
+my @subs;
+BEGIN {
+    # the "+ 0"s make enough ops for a fragment
+    @subs = mode_subs(<<'EOS', qw(default noov ovfloat float integer));
+    my ($x, $y) = @_;
+    my $z;
+    $z = sqrt($x * $x + $y * $y);
+    return [ $z, sin($x) + cos($y), exp($x / 10) * 1, log($x * $x + 1) + 0,
+             abs($x - $y) + 0, int($x / $y) + 0, atan2($y, $x) + 0 ];
+EOS
+}
+
+my @values =
+  (
+    [ 3, 4 ], [ -1.5, 2 ], [ 0, 1 ], [ 1e10, 3 ], [ "7", "-2" ],
+    [ -8, -3 ], [ 9**9**9, 1 ],
+  );
+
+for my $mode (@subs) {
+    my ($name, $fmc, $perl) = @$mode;
+    for my $pair (@values) {
+        is($fmc->(@$pair), $perl->(@$pair), "$name: @$pair");
+    }
+    # "+float" loses the low bits
+    is($fmc->(~0, 1), $perl->(~0, 1), "$name: large UV")
+      unless $name =~ /float/;
+}
+
+{
+    use Faster::Maths::CC;
+    my $x = -4;
+    ok(!eval { my $r = sqrt($x * 1 + 0); 1 }, "sqrt of negative dies");
+    like($@, qr/^Can't take sqrt of -4/, "sqrt message");
+    $x = 0;
+    ok(!eval { my $r = log($x * 1 + 0); 1 }, "log of 0 dies");
+    like($@, qr/^Can't take log of 0/, "log message");
+}
+
+{
+    package Num;
+    use overload
+      sqrt => sub ($x, @) { 100 + $x->{v} },
+      abs => sub ($x, @) { 200 + $x->{v} },
+      "+" => sub ($x, $y, $swap) { Num->new($x->{v} + $y) };
+    sub new ($class, $v) { bless { v => $v }, $class }
+}
+
+{
+    use Faster::Maths::CC;
+    my $x = Num->new(4);
+    is(sqrt($x) + abs($x), 308, "overloaded sqrt() and abs()");
+    my $s;
+    $s = sqrt($x + 1);
+    is($s, 105, "overloaded sqrt() assigned to a lexical");
+}
+
+ok(grep($_->[0] =~ /NV nv\d+ = do_sin_nv\(/,
+        @Faster::Maths::CC::collection),
+   "we compiled a raw sin()");
+
+done_testing;
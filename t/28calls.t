@@ -0,0 +1,100 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(mode_subs);
+use POSIX ();
+use List::Util qw(min max sum);
+
+# calls to some POSIX and List::Util functions are made directly from
+# the generated code, compare against perl for the various modes
+
+# set up at BEGIN time so the subs are compiled before CHECK
+my @subs;
+BEGIN {
+    @subs = mode_subs(<<'EOS', qw(default noov ovfloat float));
+    my ($x, $y) = @_;
+    return [ POSIX::floor($x / $y) + 0, POSIX::ceil($x / $y) + 0,
+             POSIX::fmod($x, $y) + 0, POSIX::fmod($x * 1, 3) + 0,
+             min($x, $y, 1) + 0, max($x + 0, $y) + 0,
+             sum($x * 2, $y, 3) + 0, sum($x + 0) + 0 ];
+EOS
+}
+
+my @values =
+  (
+    [ 7, 2 ], [ -7, 2 ], [ 7.5, -2 ], [ 0.5, 0.25 ], [ "10", "3" ],
+    [ 1e10, 7 ],
+  );
+
+for my $mode (@subs) {
+    my ($name, $fmc, $perl) = @$mode;
+    for my $pair (@values) {
+        is($fmc->(@$pair), $perl->(@$pair), "$name: @$pair");
+    }
+}
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/do_posix_floor\(/, "floor() called directly");
+    like($code, qr/do_list_min\(/, "min() called directly");
+    like($code, qr/do_list_sum\(/, "sum() called directly");
+    unlike($code, qr/do_list_\w+\(aTHX_ [^,]+, args\d+, 0\)/,
+           "no empty lists");
+}
+
+{
+    use Faster::Maths::CC;
+    my ($x, $y) = ("10", 9);
+    my $r = min($x, $y * 1) + 1;
+    is($r, 10, "min() of a string and a number");
+    is(sum(~0 - 1, 1, 1) + 0, ~0 + 1, "sum() overflows to NV like perl");
+    is(sum(-5, 3) * 1, -2, "sum() of mixed signs");
+}
+
+{
+    package Num;
+    use overload
+      "+" => sub ($x, $y, $swap) { Num->new($x->{v} + (ref $y ? $y->{v} : $y)) },
+      ">" => sub ($x, $y, $swap) {
+          my $r = $x->{v} > (ref $y ? $y->{v} : $y);
+          $swap ? !$r : $r
+      },
+      "0+" => sub ($x, @) { $x->{v} },
+      fallback => 1;
+    sub new ($class, $v) { bless { v => $v }, $class }
+}
+
+{
+    use Faster::Maths::CC;
+    my $x = Num->new(4);
+    my $s = sum($x, 2, 3);
+    is(ref $s, "Num", "sum() with an object uses overloading");
+    is($s->{v}, 9, "overloaded sum() value");
+    my $m = max($x, 1 + 0);
+    is(ref $m, "Num", "max() returns the object");
+    is(POSIX::floor($x / 3) + 0, 1, "floor() numifies the object");
+}
+
+{
+    package NotPOSIX;
+    sub floor ($x) { 42 }
+}
+
+{
+    use Faster::Maths::CC;
+    my $x = 1.5;
+    is(NotPOSIX::floor($x) + 1, 43, "perl subs aren't replaced");
+}
+
+{
+    use Faster::Maths::CC;
+    my ($i, $s) = (0, 0);
+    while ($i < 5) {
+        $s = $s + max($i, 2) + POSIX::floor($i / 2);
+        $i = $i + 1;
+    }
+    is($s, 17, "direct calls in a loop");
+}
+
+done_testing;
@@ -27,6 +27,8 @@ use Math::BigFloat;
   is( $two * $four + $one, "((2 * 4) + 1)", '2*4+1 is 9' );
   is( $two * ( $four + $one ), "(2 * (4 + 1))", '2*(4+1) is 10' );
   is( - ($one + $two + $four), '(- ((1 + 2) + 4))', '-(1+2+4) is -7' );
+  is( $one + $two < $four * $two, "((1 + 2) < (4 * 2))", '1+2 < 4*2' );
+  is( $one * $two <=> $four, "((1 * 2) <=> 4)", '1*2 <=> 4' );
 }
 
 {
@@ -50,6 +52,8 @@ use Math::BigFloat;
   is( $two * $four + $one, "((2 * 4) + 1)", '2*4+1 is 9' );
   is( $two * ( $four + $one ), "(2 * (4 + 1))", '2*(4+1) is 10' );
   is( - ($one + $two + $four), '(- ((1 + 2) + 4))', '-(1+2+4) is -7' );
+  is( $one + $two < $four * $two, "((1 + 2) < (4 * 2))", '1+2 < 4*2' );
+  is( $one * $two <=> $four, "((1 * 2) <=> 4)", '1*2 <=> 4' );
 }
 
 {
@@ -73,6 +77,7 @@ use Math::BigFloat;
   is( $two * $four + $one, 9, '2*4+1 is 9' );
   is( $two * ( $four + $one ), 10, '2*(4+1) is 10' );
   is( - ($one + $two + $four), -7, '-(1+2+4) is -7' );
+  ok( $one + $two < $four * $two, '1+2 < 4*2' );
 }
 
 {
@@ -96,6 +101,7 @@ use Math::BigFloat;
   is( $two * $four + $one, 9, '2*4+1 is 9' );
   is( $two * ( $four + $one ), 10, '2*(4+1) is 10' );
   is( - ($one + $two + $four), -7, '-(1+2+4) is -7' );
+  ok( $one + $two < $four * $two, '1+2 < 4*2' );
 }
 
 ok(@Faster::Maths::CC::collection, "we compiled something");
@@ -116,6 +122,8 @@ package Bodmas {
     '-' => sub { wrap("-", @_) },
     '*' => sub { wrap("*", @_) },
     '/' => sub { wrap("/", @_) },
+    '<' => sub { wrap("<", @_) },
+    '<=>' => sub { wrap("<=>", @_) },
     'neg' => sub($arg, @) {
       __PACKAGE__->new("(- $arg->[0])")
     },
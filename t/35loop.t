@@ -0,0 +1,157 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# whole loops compiled into a single fragment
+
+my $all = \@Faster::Maths::CC::collection;
+
+sub sum_squares ($i, $n) {
+    use Faster::Maths::CC;
+    my $s = 0;
+    while ($i < $n) {
+        $s = $s + $i * $i;
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(sum_squares(0, 10), 285, "while loop");
+is(sum_squares(5, 1), 0, "while loop, no iterations");
+
+sub count_until ($i, $n) {
+    use Faster::Maths::CC;
+    until ($i > $n) {
+        $i = $i + 3;
+    }
+    return $i;
+}
+
+is(count_until(0, 10), 12, "until loop");
+
+sub c_for ($n) {
+    use Faster::Maths::CC;
+    my ($i, $s);
+    $i = $s = 0;
+    for (; $i < $n; $i = $i + 1) {
+        $s = $s + $i;
+        next;
+        $s = $s + 1000;
+    }
+    return $s + $i;
+}
+
+is(c_for(5), 15, "for(;;) with next");
+
+sub last_loop ($i) {
+    use Faster::Maths::CC;
+    while (1) {
+        $i = $i * 2;
+        last;
+        $i = $i + 1000;
+    }
+    return $i;
+}
+
+is(last_loop(21), 42, "while(1) with last");
+
+sub return_loop ($i) {
+    use Faster::Maths::CC;
+    while (1) {
+        $i = $i + 1;
+        return $i * 2 + 1;
+    }
+    return 0;
+}
+
+is(return_loop(1), 5, "return from inside a loop");
+is([ return_loop(2) ], [ 7 ], "return from inside a loop (list)");
+
+sub nested ($n) {
+    use Faster::Maths::CC;
+    my ($i, $j, $s) = (0, 0, 0);
+    while ($i < $n) {
+        $j = $j - $j;
+        while ($j < $i) {
+            $s = $s + $j;
+            $j = $j + 1;
+        }
+        {
+            # next leaves a bare block
+            $s = $s + 1;
+            next;
+        }
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(nested(5), 15, "nested loops and bare block");
+
+{
+    my $code = join "", map $_->[0], @$all;
+    like($code, qr/for \(;;\) \{/, "we compiled a loop");
+    # the loop body shouldn't have been compiled separately
+    my @frags = grep $_->[3] eq __FILE__ && $_->[2] >= 9 && $_->[2] <= 17,
+      @$all;
+    is(@frags, 1, "one fragment for sum_squares()")
+      or diag map $_->[0], @frags;
+    # nor the inner loop of nested()
+    @frags = grep $_->[3] eq __FILE__ && $_->[2] >= 71 && $_->[2] <= 85,
+      @$all;
+    is(@frags, 1, "one fragment for nested()")
+      or diag map $_->[0], @frags;
+}
+
+sub warn_line ($x) {
+    use Faster::Maths::CC;
+    my $count = 0;
+    while ($count < 2) {
+        $count = $count + 1;
+        $count = $count + $x; # warning here
+    }
+    return $count;
+}
+
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    use warnings;
+    is(warn_line(undef), 2, "undef in loop");
+    my $line = warn_line_number();
+    like($warn[0], qr/ line $line\b/, "warning reports the right line");
+}
+
+{
+    package Counter;
+    use overload
+      "+" => sub ($x, $y, $swap) { Counter->new($x->{v} + (ref $y ? $y->{v} : $y)) },
+      "<" => sub ($x, $y, $swap) {
+          my $r = $x->{v} < (ref $y ? $y->{v} : $y);
+          $swap ? !$r : $r
+      };
+    sub new ($class, $v) { bless { v => $v }, $class }
+}
+
+{
+    my $x = Counter->new(0);
+    my $i = 0;
+    {
+        use Faster::Maths::CC;
+        while ($i < 5) {
+            $x = $x + 2;
+            $i = $i + 1;
+        }
+    }
+    is($x->{v}, 10, "overloading in a loop");
+}
+
+done_testing;
+
+sub warn_line_number {
+    open my $fh, "<", __FILE__ or die;
+    while (<$fh>) {
+        return $. if /# warning here$/;
+    }
+    die "no warning line";
+}
@@ -0,0 +1,183 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# scalar assignments within fragments
+
+sub intro ($a, $b) {
+    use Faster::Maths::CC;
+    my $x = $a * $b + 1;
+    my $y = $x * 2 + $a;
+    return $y;
+}
+
+is(intro(2, 3), 16, "my \$x = ...");
+
+sub assign ($h) {
+    use Faster::Maths::CC;
+    my ($x, $y);
+    $x = $h->{a};
+    $y = ($x = $h->{b}) * 2 + 1;
+    return [ $x, $y ];
+}
+
+is(assign({ a => 1, b => 4 }), [ 4, 9 ], "assignment to existing lexicals");
+
+sub float ($a, $b) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my $x = $a * $b + 0.5;
+    return $x;
+}
+
+is(float(2, 3), 6.5, "raw value assigned directly");
+
+{
+    my @subs;
+    for my $i (1 .. 3) {
+        use Faster::Maths::CC;
+        my $x = $i * 2 + 1;
+        push @subs, sub { $x };
+    }
+    is([ map $_->(), @subs ], [ 3, 5, 7 ], "each \"my\" is a new variable");
+}
+
+{
+    package CountStore;
+    sub TIESCALAR ($class) { bless { stores => 0 }, $class }
+    sub FETCH ($self) { $self->{value} }
+    sub STORE ($self, $v) { ++$self->{stores}; $self->{value} = $v }
+}
+
+{
+    tie my $t, "CountStore";
+    my $h = { a => 5 };
+    my $x = do {
+        use Faster::Maths::CC;
+        $t = $h->{a};
+        $t * 2 + 1;
+    };
+    is($x, 11, "assignment to a tied lexical");
+    is(tied($t)->{stores}, 1, "stored once");
+}
+
+sub loop ($r) {
+    use Faster::Maths::CC;
+    my ($i, $s, $e) = (0, 0, 0);
+    while ($i < 3) {
+        $e = $r->[$i];
+        $s = $s + $e * $e;
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(loop([ 1, 2, 3 ]), 14, "assignment in a loop");
+
+sub loop_my ($r) {
+    use Faster::Maths::CC;
+    my ($i, $s) = (0, 0);
+    my @keep;
+    while ($i < 3) {
+        my $e = $r->[$i] * 2 + 1;
+        push @keep, \$e;
+        $s = $s + $e;
+        $i = $i + 1;
+    }
+    return [ $s, map $$_, @keep ];
+}
+
+is(loop_my([ 1, 2, 3 ]), [ 15, 3, 5, 7 ], "\"my\" in a loop");
+
+sub fib ($n) {
+    use Faster::Maths::CC;
+    my ($i, $x, $y) = (0, 0, 1);
+    while ($i < $n) {
+        ($x, $y) = ($y, $x + $y);
+        $i = $i + 1;
+    }
+    return $x;
+}
+
+is(fib(10), 55, "list assignment swapping variables");
+
+sub julia ($zr, $zi, $cr, $ci) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my $count = 0;
+    while ($count < 3) {
+        ($zr, $zi) = ($zr * $zr - $zi * $zi + $cr, 2 * $zr * $zi + $ci);
+        $count = $count + 1;
+    }
+    return [ $zr, $zi ];
+}
+
+is(julia(0, 0, 0.5, 0.25), [ 0.72265625, 0.9375 ],
+   "list assignment of raw values");
+
+sub list_my ($r) {
+    use Faster::Maths::CC;
+    my ($p, $q) = ($r->[0] * 2, $r->[1] + 1);
+    ($p, $q) = ($q, $p);
+    return [ $p, $q ];
+}
+
+is(list_my([ 3, 4 ]), [ 5, 6 ], "my (...) = list");
+
+{
+    my @subs;
+    for my $i (1 .. 2) {
+        use Faster::Maths::CC;
+        my ($x, $y) = ($i * 2, $i + 1);
+        push @subs, sub { "$x,$y" };
+    }
+    is([ map $_->(), @subs ], [ "2,2", "4,3" ],
+       "each \"my (...)\" makes new variables");
+}
+
+{
+    my @a = (1, 2);
+    my ($i, @f) = (0);
+    for my $e (@a) {
+        use Faster::Maths::CC;
+        my $f = 0;
+        # $e is an alias for the element
+        ($e, $f) = ($i * 0 + 5, $a[$i + 0]);
+        push @f, $f;
+        $i = $i + 1;
+    }
+    is(\@f, [ 1, 2 ], "aliased element copied first");
+    is(\@a, [ 5, 5 ], "aliased variables assigned");
+}
+
+sub raw_assign ($a, $b) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my $lt = $a * 2 < $b + 1;
+    my $h = $a * 0.5 + $b;
+    return [ $lt ? 1 : 0, $h ];
+}
+
+is(raw_assign(2, 6), [ 1, 7 ], "raw bool and raw NV assigned");
+is(raw_assign(3, 4), [ 0, 5.5 ], "false raw bool assigned");
+
+sub int_assign ($a, $b) {
+    use Faster::Maths::CC;
+    use integer;
+    my $ge = $a + 1 >= $b;
+    return $ge ? "yes" : "no";
+}
+
+is(int_assign(2, 3), "yes", "integer raw bool assigned");
+is(int_assign(1, 3), "no", "false integer raw bool assigned");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/do_aassign_copy\(/, "generated alias-safe copies");
+    like($code, qr/SAVECLEARSV\(PAD_SVl\(\d+\)\)/, "generated \"my\"");
+    like($code, qr/do_sassign\(/, "generated assignments");
+    like($code, qr/fast_sv_setnv\(aTHX_ loc\d+, nv\d+\)/,
+         "generated raw assignments");
+}
+
+done_testing;
@@ -0,0 +1,71 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# small subs compiled to C functions called directly from fragments
+
+sub dist ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    sqrt($x * $x + $y * $y)
+}
+
+sub scale {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($x, $k) = @_;
+    $x * $k + 0.5
+}
+
+sub less ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    $x * 1 < $y * 1
+}
+
+# calls another leaf
+sub scaled_dist ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    dist($x, $y) * 2
+}
+
+# not compiled with "+float"
+sub plain ($x) {
+    use Faster::Maths::CC;
+    $x * 3 + 1
+}
+
+sub same ($x) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    $x
+}
+
+{
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($a, $b) = (3, 4);
+    is(dist($a, $b) + 1, 6, "signature leaf");
+    is(scale($a, $b) * 2, 25, "my (...) = \@_ leaf");
+    ok(less($a, $b) + 0, "boolean leaf");
+    is(scaled_dist($a, $b) + 0, 10, "leaf calling a leaf");
+    is(plain($a) + 0, 10, "non-float sub called normally");
+    is(same("3abc") . "", "3abc", "sub returning its parameter");
+    ok(!eval { my $r = dist($a, $b, 1) + 1; 1 }, "too many arguments");
+    like($@, qr/Too many arguments/, "dies in the sub");
+}
+
+{
+    my $leaves = join "", @Faster::Maths::CC::leaves;
+    like($leaves, qr/^static inline NV\nleaf\d+\(pTHX_ NV nv0, NV nv1\)/m,
+         "generated a leaf function");
+    is(scalar(@Faster::Maths::CC::leaves), 4, "only the expected leaves")
+      or diag $leaves;
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/ = leaf\d+\(aTHX_ /, "a fragment calls a leaf");
+}
+
+is(dist(6, 8), 10, "perl callers still work");
+
+done_testing;
@@ -0,0 +1,136 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# array element fetches within fragments
+
+our @g = (1.5, 2, 3);
+
+sub fast_lex ($x) {
+    use Faster::Maths::CC;
+    my @v = (2, 3, 4);
+    return $v[0] * $v[1] + $v[2] * $x + $v[-1];
+}
+
+is(fast_lex(2), 18, "aelemfast_lex");
+
+sub fast_pkg ($x) {
+    use Faster::Maths::CC;
+    return $g[0] * $g[1] + $g[2] * $x;
+}
+
+is(fast_pkg(2), 9, "aelemfast");
+
+sub args {
+    use Faster::Maths::CC;
+    return $_[0] * $_[1] + $_[2];
+}
+
+is(args(3, 4, 5), 17, "elements of \@_");
+
+sub elem_lex ($i) {
+    use Faster::Maths::CC;
+    my @v = (1, 2, 3, 4);
+    my @w = (10, 20, 30, 40);
+    return $v[$i + 1] * $w[$i - 1] + $v[$i * 1];
+}
+
+is(elem_lex(1), 32, "aelem on lexical arrays");
+is(elem_lex(0), 81, "aelem negative index");
+
+sub elem_pkg ($i) {
+    use Faster::Maths::CC;
+    return $g[$i + 1] * $g[$i - 1] + 1;
+}
+
+is(elem_pkg(1), 5.5, "aelem on a package array");
+
+sub elem_ref ($r, $i) {
+    use Faster::Maths::CC;
+    return $r->[$i + 1] * $$r[$i - 1] + 1;
+}
+
+is(elem_ref([ 2, 3, 4 ], 1), 9, "aelem on an array reference");
+
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    use warnings;
+    my $r;
+    my $x = eval {
+        use Faster::Maths::CC;
+        no strict "refs";
+        my $i = 0;
+        $r->[$i + 5] * 2 + 1;
+    };
+    is($x, 1, "element of a vivified array");
+    is($r, [], "reference vivified");
+    like($warn[0], qr/uninitialized/, "undef element warns");
+}
+
+{
+    my $r = 1;
+    ok(!eval {
+        use Faster::Maths::CC;
+        my $i = 0;
+        my $x = $r->[$i + 1] * 2 + 1;
+        1
+    }, "bad dereference");
+    like($@, qr/Can't use string \("1"\) as an ARRAY ref/,
+         "perl reports the error");
+}
+
+{
+    package CountFetch;
+    sub TIEARRAY ($class) { bless { fetches => 0 }, $class }
+    sub FETCH ($self, $i) { ++$self->{fetches}; $i * 10 }
+    sub FETCHSIZE ($self) { 3 }
+}
+
+{
+    tie my @t, "CountFetch";
+    my $i = 1;
+    my $x = do {
+        use Faster::Maths::CC;
+        $t[$i + 1] * 2 + $t[0];
+    };
+    is($x, 40, "tied array");
+    is(tied(@t)->{fetches}, 2, "each element fetched once");
+}
+
+{
+    package ArrayObj;
+    use overload '@{}' => sub ($self, @) { $self->{array} },
+      fallback => 1;
+    sub new ($class, @v) { bless { array => \@v }, $class }
+}
+
+{
+    my $o = ArrayObj->new(5, 6, 7);
+    my $i = 1;
+    my $x = do {
+        use Faster::Maths::CC;
+        $o->[$i + 1] * 2 + 1;
+    };
+    is($x, 15, "overloaded array dereference");
+}
+
+sub dot ($v, $w, $n) {
+    use Faster::Maths::CC;
+    my ($i, $s) = (0, 0);
+    while ($i < $n) {
+        $s = $s + $v->[$i + 0] * $w->[$i + 0];
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(dot([ 1, 2, 3 ], [ 4, 5, 6 ], 3), 32, "element fetches in a loop");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/do_aelem\(/, "generated element fetches");
+    like($code, qr/do_rv2av\(/, "generated dereferences");
+}
+
+done_testing;
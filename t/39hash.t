@@ -0,0 +1,137 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# hash element fetches within fragments
+
+our %g = (x => 1.5, y => 2);
+our $gs = { x => 3, y => 4 };
+
+sub point ($p) {
+    use Faster::Maths::CC;
+    return $p->{x} * $p->{y} + 1;
+}
+
+is(point({ x => 2, y => 3 }), 7, "element of a hash reference");
+
+sub lex_hash ($k) {
+    use Faster::Maths::CC;
+    my %h = (x => 2, y => 5, 3 => 10);
+    return $h{x} * $h{y} + $h{$k + 1};
+}
+
+is(lex_hash(2), 20, "lexical hash, constant and computed keys");
+
+sub pkg_hash ($x) {
+    use Faster::Maths::CC;
+    return $g{x} * $g{y} + $gs->{x} * $x;
+}
+
+is(pkg_hash(2), 9, "package hash and hash reference");
+
+sub nested ($p) {
+    use Faster::Maths::CC;
+    return $p->{a}{b} * 2 + $p->{a}{c} * 1;
+}
+
+is(nested({ a => { b => 3, c => 4 } }), 10, "nested hashes");
+
+sub unicode ($p) {
+    use Faster::Maths::CC;
+    use utf8;
+    return $p->{"ñ"} * 2 + 1;
+}
+
+{
+    use utf8;
+    is(unicode({ "ñ" => 5 }), 11, "UTF-8 key");
+}
+
+my $point = { x => 6, y => 7 };
+sub get_point { $point }
+
+{
+    my $x = do {
+        use Faster::Maths::CC;
+        get_point()->{x} * 2 + 1;
+    };
+    is($x, 13, "element of a returned reference");
+}
+
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    use warnings;
+    my $r;
+    my $x = do {
+        use Faster::Maths::CC;
+        $r->{a}{b} * 2 + 1;
+    };
+    is($x, 1, "missing element");
+    is($r, { a => {} }, "references vivified");
+    like($warn[0], qr/uninitialized/, "undef element warns");
+}
+
+{
+    my $r = "name";
+    ok(!eval {
+        use Faster::Maths::CC;
+        my $x = $r->{x} * 2 + 1;
+        1
+    }, "symbolic reference under strict");
+    like($@, qr/Can't use string \("name"\) as a HASH ref/,
+         "perl's error message");
+}
+
+{
+    package CountFetch;
+    sub TIEHASH ($class) { bless { fetches => 0 }, $class }
+    sub FETCH ($self, $k) { ++$self->{fetches}; length $k }
+}
+
+{
+    tie my %t, "CountFetch";
+    my $x = do {
+        use Faster::Maths::CC;
+        $t{abc} * 2 + $t{de};
+    };
+    is($x, 8, "tied hash");
+    is(tied(%t)->{fetches}, 2, "each element fetched once");
+}
+
+{
+    package HashObj;
+    use overload '%{}' => sub ($self, @) { $$self }, fallback => 1;
+    sub new ($class, %v) { my $h = \%v; bless \$h, $class }
+}
+
+{
+    my $o = HashObj->new(x => 5);
+    my $x = do {
+        use Faster::Maths::CC;
+        $o->{x} * 2 + 1;
+    };
+    is($x, 11, "overloaded hash dereference");
+}
+
+sub norm ($points) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($i, $s) = (0, 0);
+    while ($i < 3) {
+        $s = $s + $points->{x} * $points->{x} + $points->{y} * 1;
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(norm({ x => 2, y => 1 }), 15, "element fetches in a loop");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code,
+         qr/do_helem\(aTHX_ \(HV \*\)loc\d+, md_item_sv\(.*\(U32\)aux\[\d+\]\.uv\)/,
+         "constant key hashes are precomputed");
+}
+
+done_testing;
@@ -0,0 +1,118 @@
+#!perl
+use v5.42;
+use Test2::V0;
+
+# element chains perl merges into OP_MULTIDEREF
+
+our @ga = (5, 6, 7);
+our $gi = 1;
+our $gr = [ [ 1, 2, 3 ], [ 4, 5, 6 ] ];
+
+sub mixed ($r, $i) {
+    use Faster::Maths::CC;
+    return $r->[$i]{$gi}[0] * 2 + $ga[$i];
+}
+
+is(mixed([ {}, { 1 => [ 3 ] } ], 1), 12,
+   "mixed chain, lexical and package indexes");
+
+sub pkg_chain ($x) {
+    use Faster::Maths::CC;
+    return $gr->[$gi][-1] * $x + $gr->[0][1];
+}
+
+is(pkg_chain(2), 14, "package reference, negative index");
+
+sub then_aelem ($r, $i) {
+    use Faster::Maths::CC;
+    return $r->{a}[$i + 1] * 2 + 1;
+}
+
+is(then_aelem({ a => [ 1, 2, 3 ] }, 1), 7, "chain followed by aelem");
+
+sub args {
+    use Faster::Maths::CC;
+    return $_[0]{x} * $_[1][1] + 1;
+}
+
+is(args({ x => 3 }, [ 0, 4 ]), 13, "elements of \@_ elements");
+
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    use warnings;
+    my $r;
+    my $i = 2;
+    my $x = do {
+        use Faster::Maths::CC;
+        $r->[$i]{a}[1] * 2 + 1;
+    };
+    is($x, 1, "missing element");
+    is($r, [ undef, undef, { a => [] } ], "intermediate elements vivified");
+    like($warn[0], qr/uninitialized/, "undef element warns");
+}
+
+{
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    use warnings;
+    my $r = [ 1, 2 ];
+    my $i = [];
+    my $x = do {
+        use Faster::Maths::CC;
+        $r->[$i] * 2 + 1;
+    };
+    like($warn[0], qr/Use of reference .* as array index/,
+         "reference index warns");
+}
+
+{
+    my $r = [ "name" ];
+    ok(!eval {
+        use Faster::Maths::CC;
+        my $x = $r->[0][1] * 2 + 1;
+        1
+    }, "symbolic reference under strict");
+    like($@, qr/Can't use string \("name"\) as an ARRAY ref/,
+         "perl's error message");
+}
+
+{
+    package CountFetch;
+    sub TIEARRAY ($class) { bless { fetches => 0 }, $class }
+    sub FETCH ($self, $i) { ++$self->{fetches}; $i * 10 }
+    sub FETCHSIZE ($self) { 3 }
+}
+
+{
+    tie my @t, "CountFetch";
+    my $r = { t => \@t };
+    my $i = 2;
+    my $x = do {
+        use Faster::Maths::CC;
+        $r->{t}[$i] * 2 + $r->{t}[1];
+    };
+    is($x, 50, "tied array at the end of a chain");
+    is(tied(@t)->{fetches}, 2, "each element fetched once");
+}
+
+sub dot ($v, $w) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($i, $s) = (0, 0);
+    while ($i < 3) {
+        $s = $s + $v->[$i] * $w->[$i];
+        $i = $i + 1;
+    }
+    return $s;
+}
+
+is(dot([ 1, 2, 3 ], [ 4, 5, 6 ]), 32, "variable indexes in a loop");
+
+{
+    my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+    like($code, qr/do_md_rv2av\(/, "generated array dereferences");
+    like($code, qr/do_md_index\(/, "generated variable indexes");
+}
+
+done_testing;
@@ -96,6 +96,39 @@ sub f_dual {
 
 code_like(qr/\$f_dual/, qr(/\* NV 23.1 PV "abc" \*/), "sv_summary dual");
 
+sub f_raw {
+  use Faster::Maths::CC "+float";
+  no overloading;
+  my $f_raw;
+  $f_raw = $x * $y * $y + 1;
+}
+
+{
+  my $code = code(qr/\$f_raw/);
+  like($code, qr/NV nv\d+ = /, "intermediates kept as NVs");
+  my @stores = $code =~ /(fast_sv_setnv)/g;
+  is(@stores, 1, "only the final result is stored")
+    or diag $code;
+  ($x, $y) = (2, 3);
+  is(f_raw(), 19, "result is correct");
+}
+
+sub f_lit {
+  use Faster::Maths::CC "+float";
+  no overloading;
+  my $f_lit;
+  $f_lit = $x * 0.25 + 2;
+}
+
+{
+  my $code = code(qr/\$f_lit/);
+  like($code, qr/NV nv\d+ = 0x1p-2;/, "NV constant as a literal");
+  like($code, qr/IV iv\d+ = 2;/, "IV constant as a literal");
+  unlike($code, qr/aux\[/, "constants not fetched from the op");
+  ($x, $y) = (2, 3);
+  is(f_lit(), 2.5, "result is correct");
+}
+
 done_testing();
 
 sub code ($re) {
@@ -0,0 +1,96 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(code);
+
+# repeated arithmetic on the same values is only done once
+
+sub count ($code, $re) {
+    my @matches = $code =~ /$re/g;
+    return scalar @matches;
+}
+
+sub squares ($x, $y) {
+    use Faster::Maths::CC;
+    my $squares = $x * $y + $x * $y + $x * $x;
+    return $squares;
+}
+
+is(squares(3, 4), 33, "integers");
+is(squares(1.5, 2), 8.25, "floats use the generic code");
+{
+    no warnings "imprecision";
+    my $max = ~0 >> 1;
+    my $want = $max * 1 + $max * 1 + $max * $max;
+    is(squares($max, 1), $want, "overflow falls back to the generic code");
+}
+
+{
+    my $code = code(qr/\$squares/);
+    my ($spec) = $code =~ /^(if \(guard_iv_read.*?^\})/ms
+      or diag $code;
+    is(count($spec, qr/SvIVX\(/), 2, "each variable read once");
+    is(count($spec, qr/my_iv_mul_may_overflow\(iv\d+, iv\d+,/), 2,
+       "each product computed once")
+      or diag $spec;
+}
+
+sub stored ($x) {
+    use Faster::Maths::CC;
+    use integer;
+    my $stored;
+    my $r = ($stored = $x + 1) * $stored;
+    return [ $stored, $r ];
+}
+
+is(stored(4), [ 5, 25 ], "stored value used directly");
+{
+    my $code = code(qr/\$stored/);
+    like($code, qr/guard_iv_store/, "stored is specialised");
+    is(count($code, qr/SvIVX\(/), 1, "stored value not read back");
+}
+
+sub literals {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($x, $y) = @_;
+    my $literals = $x * 2.5 + $y * 2.5;
+    return $literals;
+}
+
+is(literals(2, 4), 15, "literals");
+is(count(code(qr/\$literals/), qr/= 0x1\.4p\+1;/), 1, "literal declared once");
+
+sub norm ($x, $y) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    ($x * $y + 1) * ($x * $y + 1)
+}
+
+{
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($a, $b) = (2, 3);
+    is(norm($a, $b) + 0, 49, "leaf sub");
+    my ($leaf) = grep /nv0 \* nv1/, @Faster::Maths::CC::leaves;
+    is(count($leaf, qr/nv0 \* nv1/), 1, "leaf computes the product once")
+      or diag $leaf;
+}
+
+sub redo_loop ($n) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($i, $redo_sum, $extra) = (0, 0, 0);
+    while ($i < 3) {
+        $redo_sum = $redo_sum + 3;
+        ++$extra < 3 and redo;
+        $i = $i + $n;
+    }
+    return $redo_sum;
+}
+
+is(redo_loop(1), 15, "loop with redo");
+like(code(qr/\$redo_sum/), qr/redo_\d+:;/, "loop was compiled");
+
+done_testing;
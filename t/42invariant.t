@@ -0,0 +1,116 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(code);
+
+# variables a loop doesn't change are read before it starts
+
+sub scaled_sum ($n, $k, $c) {
+    use Faster::Maths::CC "+float";
+    no overloading;
+    my ($i, $scaled) = (0, 0);
+    while ($i < $n) {
+        $scaled = $scaled + $i * $k + $c;
+        $i = $i + 1;
+    }
+    return $scaled;
+}
+
+is(scaled_sum(4.0, 0.5, 0.25), 4, "plain floats");
+is(scaled_sum(4, 0.5, 0.25), 4, "an integer uses the general loop");
+is(scaled_sum(4.0, "0.5", 0.25), 4, "a string uses the general loop");
+{
+    my $code = code(qr/\$scaled/);
+    like($code, qr/guard_invariant_nv\(loc\d+\) &&/, "checked before the loop");
+    like($code, qr/NV nv\d+ = SvNVX\(loc\d+\);\nfor \(;;\)/,
+         "read before the loop");
+    is(scalar(() = $code =~ /for \(;;\)/g), 2, "and a general loop");
+    unlike($code, qr/guard_invariant_nv\(\Q$1\E\)/, "\$i is changed")
+      if $code =~ m(SV \*(loc\d+) = PAD_SV\(\d+\) /\* \$i \*/);
+}
+
+{
+    package Fetches;
+    sub TIESCALAR ($class, $v) { bless { v => $v, fetches => 0 }, $class }
+    sub FETCH ($self) { ++$self->{fetches}; $self->{v} }
+}
+
+{
+    tie my $k, "Fetches", 0.5;
+    my ($i, $s) = (0, 0);
+    {
+        use Faster::Maths::CC "+float";
+        no overloading;
+        while ($i < 3.0) {
+            $s = $s + $k;
+            $i = $i + 1;
+        }
+    }
+    is($s, 1.5, "tied variable");
+    is(tied($k)->{fetches}, 3, "fetched each time");
+}
+
+{
+    my $k = 0.5;
+    my $n = 3.0;
+    # FETCH of $n changes $k, which the closure refers to
+    my $bump = sub { $k = $k * 2 };
+    {
+        package Bump;
+        sub TIESCALAR ($class, $v, $bump) { bless [ $v, $bump ], $class }
+        sub FETCH ($self) { $self->[1]->(); $self->[0] }
+    }
+    tie my $tn, "Bump", $n, $bump;
+    my $want = do {
+        my ($i, $s) = (0, 0);
+        while ($i < $tn) {
+            $s = $s + $k;
+            $i = $i + 1;
+        }
+        $s;
+    };
+    $k = 0.5;
+    my ($i, $s) = (0, 0);
+    {
+        use Faster::Maths::CC "+float";
+        no overloading;
+        while ($i < $tn) {
+            $s = $s + $k;
+            $i = $i + 1;
+        }
+    }
+    is($s, $want, "variable referred to elsewhere read each time");
+}
+
+sub int_sum ($n, $k) {
+    use Faster::Maths::CC;
+    use integer;
+    no overloading;
+    my ($i, $int_sum) = (0, 0);
+    while ($i < $n) {
+        $int_sum = $int_sum + $i * $k;
+        $i = $i + 1;
+    }
+    return $int_sum;
+}
+
+is(int_sum(4, 3), 18, "integers");
+is(int_sum(4.5, 3), 18, "a float uses the general loop");
+like(code(qr/\$int_sum/), qr/guard_invariant_iv\(/, "integer version");
+
+sub overloaded_loop ($n, $k) {
+    use Faster::Maths::CC;
+    my ($i, $ov_sum) = (0, 0);
+    while ($i < $n) {
+        $ov_sum = $ov_sum + $k;
+        $i = $i + 1;
+    }
+    return $ov_sum;
+}
+
+is(overloaded_loop(3, 2), 6, "overloading");
+unlike(code(qr/\$ov_sum/), qr/guard_invariant/,
+       "only without overloading");
+
+done_testing;
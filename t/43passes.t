@@ -0,0 +1,87 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(code);
+use File::Temp;
+
+# the optimisation passes over the IV specialisation
+
+sub folded ($x) {
+    use Faster::Maths::CC;
+    use integer;
+    my $k;
+    my $folded = $x + ($k = 6) * 7;
+    return [ $k, $folded ];
+}
+
+is(folded(1), [ 6, 43 ], "folded");
+{
+    my $code = code(qr/\$folded/);
+    my ($spec) = $code =~ /^(if \(guard_iv_.*?^\})/ms
+      or diag $code;
+    like($spec, qr/IV iv\d+ = 42;/, "product of constants folded");
+    unlike($spec, qr/do_i_multiply_raw/, "not multiplied at run time");
+    unlike($spec, qr/= 7;/, "unused constant removed");
+    is(scalar(() = $spec =~ /SvIVX\(/g), 1, "stored value not read back");
+}
+
+my $script = <<'EOS';
+use v5.42;
+sub f ($x, $y) {
+    use Faster::Maths::CC;
+    my $r = $x * $y + $x * $y;
+    return $r;
+}
+print "result ", f(3, 4), " ", f(1.5, 2), "\n";
+my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+print "reads ", scalar(() = $code =~ /SvIVX\(/g), "\n";
+print "products ", scalar(() = $code =~ /my_iv_mul_may_overflow\(/g), "\n";
+EOS
+my $file = File::Temp->new(SUFFIX => ".pl");
+print $file $script;
+close $file;
+local $ENV{PERL_FMC_CACHE} = "";
+
+my $out = run_code($file);
+like($out, qr/^result 24 6$/m, "all passes");
+like($out, qr/^reads 2$/m, "each variable read once");
+like($out, qr/^products 1$/m, "product computed once");
+
+{
+    local $ENV{PERL_FMC_PASSES} = "";
+    $out = run_code($file);
+    like($out, qr/^result 24 6$/m, "no passes");
+    like($out, qr/^reads 4$/m, "each use read");
+    like($out, qr/^products 2$/m, "each product computed");
+}
+
+{
+    local $ENV{PERL_FMC_PASSES} = "forward";
+    $out = run_code($file);
+    like($out, qr/^result 24 6$/m, "only forwarding");
+    like($out, qr/^reads 2$/m, "each variable read once");
+    like($out, qr/^products 2$/m, "each product computed");
+}
+
+{
+    local $ENV{PERL_FMC_PASSES} = "forward,nosuch";
+    $out = run_code($file);
+    like($out, qr/unknown pass 'nosuch'/, "unknown pass");
+    like($out, qr/^reads 2$/m, "others still run");
+}
+
+{
+    local $ENV{PERL_FMC_DEBUG} = "i";
+    $out = run_code($file);
+    like($out,
+         qr/^IV specialisation after cse:\n(?:  .*\n)*  iv\d+ = multiply/m,
+         "dumped");
+}
+
+done_testing;
+
+sub run_code ($file) {
+    my $inc = join " ", map qq("-I$_"), grep !ref, @INC;
+    return scalar `"$^X" $inc "$file" 2>&1`;
+}
@@ -0,0 +1,91 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use lib "t/lib";
+use FMCTest qw(code);
+
+# raw C arithmetic without "+float" where perl's result is certain
+
+sub half ($x) {
+    use Faster::Maths::CC;
+    no overloading;
+    my $half = $x * 0.5 + 0.25;
+    return $half;
+}
+
+is(half(3), 1.75, "fraction");
+is(half(-1e300), -5e299, "large");
+{
+    my @w;
+    local $SIG{__WARN__} = sub { push @w, @_ };
+    is(half("abc"), 0.25, "string");
+    is(scalar @w, 1, "warned once")
+      or diag @w;
+}
+{
+    my $code = code(qr/\$half/);
+    like($code, qr/NV nv\d+ = SvNV\(loc\d+\) \* nv\d+;/, "raw multiply");
+    like($code, qr/NV nv\d+ = nv\d+ \+ nv\d+;/, "raw add");
+    unlike($code, qr/do_(?:multiply|add)/, "no generic arithmetic");
+}
+
+sub recip ($x) {
+    use Faster::Maths::CC;
+    no overloading;
+    my $recip = 0.5 / $x + $x / 0.5;
+    return $recip;
+}
+
+is(recip(2), 4.25, "division");
+ok(!eval { recip(0); 1 }, "by zero dies");
+like($@, qr/^Illegal division by zero/, "as perl does");
+like(code(qr/\$recip/), qr/do_divide_noov\(/,
+     "unknown divisor divided generically");
+
+sub accum ($x) {
+    use Faster::Maths::CC;
+    no overloading;
+    my $accum = 1;
+    $accum += $x * 0.5;
+    return $accum;
+}
+
+is(accum(3), 2.5, "assignment op");
+like(code(qr/\$accum/), qr/do_add_noov\(aTHX_ (loc\d+), \1,/,
+     "the lvalue is added generically");
+
+sub roots ($x, $y) {
+    use Faster::Maths::CC;
+    no overloading;
+    my $roots = (sqrt($x) < 3) == (-sqrt($y) > -2.5);
+    return $roots ? 1 : 0;
+}
+
+is(roots(4, 4), 1, "both true");
+is(roots(9, 4), 0, "one true");
+is(roots(9, 9), 1, "both false");
+{
+    my $code = code(qr/do_sqrt_nv/);
+    like($code, qr/bool b\d+ = nv\d+ < \(NV\)iv\d+;/, "small integer as NV");
+    like($code, qr/NV nv\d+ = -nv\d+;/, "raw negation");
+    like($code, qr/bool b\d+ = \(IV\)b\d+ == \(IV\)b\d+;/,
+         "bools compared as integers");
+    unlike($code, qr/do_(?:lt|gt|eq|negate)/, "no generic comparisons");
+}
+
+{
+    package Scaled;
+    use overload '*' => sub ($l, $r, $swap) { "scaled by $r" };
+}
+
+sub scaled ($x) {
+    use Faster::Maths::CC;
+    my $scaled = $x * 0.5;
+    return $scaled;
+}
+
+is(scaled(bless {}, "Scaled"), "scaled by 0.5", "overloading");
+is(scaled(3), 1.5, "number with overloading enabled");
+like(code(qr/\$scaled/), qr/do_multiply\(/, "generic with overloading");
+
+done_testing;
@@ -0,0 +1,56 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use File::Temp;
+
+# check the built module is cached and reused
+my $cache = File::Temp->newdir;
+local $ENV{PERL_FMC_CACHE} = "$cache";
+local $ENV{PERL_FMC_DEBUG} = "b";
+
+my $code = <<'EOS';
+use Faster::Maths::CC;
+my ($x, $y) = (3, 4);
+print "result ", $x * $x + $y * $y, "\n";
+EOS
+
+# the file name is part of the generated code, so reuse the file
+my $file = save_code($code);
+my $first = run_code($file);
+like($first, qr/^result 25$/m, "first run result");
+like($first, qr/^Cache store: /m, "first run stored");
+unlike($first, qr/^Cache hit/m, "first run didn't hit");
+
+my @entries = grep -d, glob "$cache/*";
+is(@entries, 1, "one cache entry");
+is([ glob "$cache/*.lock" ], [], "lock file removed");
+
+my $second = run_code($file);
+like($second, qr/^result 25$/m, "second run result");
+like($second, qr/^Cache hit: /m, "second run hit");
+unlike($second, qr/^make:/m, "second run didn't build");
+
+my $other = run_code(save_code($code =~ s/\$y \* \$y/\$y * \$x/r));
+like($other, qr/^result 21$/m, "changed code result");
+like($other, qr/^Cache store: /m, "changed code stored");
+
+{
+    local $ENV{PERL_FMC_CACHE} = "";
+    my $nocache = run_code($file);
+    like($nocache, qr/^result 25$/m, "uncached result");
+    unlike($nocache, qr/^Cache/m, "no cache used");
+}
+
+done_testing;
+
+sub save_code ($code) {
+    my $file = File::Temp->new(SUFFIX => ".pl");
+    print $file $code;
+    close $file;
+    return $file;
+}
+
+sub run_code ($file) {
+    my $inc = join " ", map qq("-I$_"), grep !ref, @INC;
+    return scalar `"$^X" $inc "$file" 2>&1`;
+}
@@ -0,0 +1,74 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use File::Temp;
+
+# PERL_FMC_PROFILE type profiles
+my $dir = File::Temp->newdir;
+local $ENV{PERL_FMC_CACHE} = "";
+local $ENV{PERL_FMC_PROFILE} = "$dir/profile";
+
+my $code = <<'EOS';
+use v5.42;
+sub f ($x, $y) {
+    use Faster::Maths::CC;
+    my $r = $x * $y + 1;
+    return $r;
+}
+my $s = 0;
+$s += f($ARGV[0] + 0, 3) for 1 .. 10;
+print "result $s\n";
+my $code = join "", map $_->[0], @Faster::Maths::CC::collection;
+print "guard ", ($code =~ /guard_iv_read/ ? "yes" : "no"), "\n";
+EOS
+
+# fragments are matched by line, so reuse the file
+my $file = save_code($code);
+my $out = run_code($file, 2);
+like($out, qr/^result 70$/m, "first run result");
+like($out, qr/^guard yes$/m, "specialised without a profile");
+my $profile = slurp("$dir/profile");
+like($profile, qr/^0\t4\t0\tiv\t10\t\Q$file\E$/m, "counted integers");
+like($profile, qr/^0\t4\t1\tiv\t10\t/m, "for each input");
+
+$out = run_code($file, 1.5);
+like($out, qr/^result 55$/m, "float run result");
+like($out, qr/^guard yes$/m, "still specialised");
+$profile = slurp("$dir/profile");
+like($profile, qr/^0\t4\t0\tiv\t20\t/m, "added to the earlier counts");
+like($profile, qr/^0\t4\t1\tiv\t10\t/m, "kept the earlier counts");
+like($profile, qr/^0\t4\t1\tnv\t10\t/m, "counted floats");
+
+$out = run_code($file, 1.5);
+like($out, qr/^result 55$/m, "profiled run result");
+like($out, qr/^guard no$/m, "not specialised for mostly floats");
+
+# the profile is for other code
+$out = run_code(save_code("\n$code"), 1.5);
+like($out, qr/^guard yes$/m, "profile ignored for changed code");
+
+{
+    local $ENV{PERL_FMC_PROFILE} = "";
+    $out = run_code($file, 1.5);
+    like($out, qr/^guard yes$/m, "profile not used when unset");
+}
+
+done_testing;
+
+sub save_code ($code) {
+    my $file = File::Temp->new(SUFFIX => ".pl");
+    print $file $code;
+    close $file;
+    return $file;
+}
+
+sub run_code ($file, @args) {
+    my $inc = join " ", map qq("-I$_"), grep !ref, @INC;
+    return scalar `"$^X" $inc "$file" @args 2>&1`;
+}
+
+sub slurp ($name) {
+    open my $fh, "<", $name or return "";
+    local $/;
+    return scalar <$fh>;
+}
@@ -0,0 +1,56 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use File::Temp;
+use Faster::Maths::CC (); # CHECK time build, but not enabled here
+
+# code compiled after CHECK is built when first run
+
+my $dir = File::Temp->newdir;
+{
+    open my $fh, ">", "$dir/FMCLate.pm" or die;
+    print $fh <<'EOS';
+package FMCLate;
+use v5.42;
+use Faster::Maths::CC;
+
+sub calc ($x, $y) {
+    return $x * $x + $y * $y - 1;
+}
+
+1;
+EOS
+    close $fh;
+}
+
+my $all = \@Faster::Maths::CC::collection;
+my $before = @$all;
+
+{
+    local @INC = ("$dir", @INC);
+    require FMCLate;
+}
+ok(@$all > $before, "generated code for the required module");
+ok(!$INC{"Faster/Maths/CC/Compiled1.pm"}, "not built yet");
+is(FMCLate::calc(3, 4), 24, "required code result");
+ok($INC{"Faster/Maths/CC/Compiled1.pm"}, "built on first call");
+is(FMCLate::calc(5, 6), 60, "required code result again");
+
+my $sub = eval <<'EOS' or die $@;
+use Faster::Maths::CC;
+sub ($x) { $x * 2 + $x * 3 }
+EOS
+is($sub->(7), 35, "string eval result");
+ok($INC{"Faster/Maths/CC/Compiled2.pm"}, "second late build");
+
+{
+    # the build shouldn't clobber $@
+    eval { die "oops\n" };
+    my $late = eval 'use Faster::Maths::CC; sub ($x) { $x * 3 - $x * 2 }'
+      or die $@;
+    eval { die "expected\n" };
+    is($late->(5), 5, "another late build");
+    is($@, "expected\n", "\$@ preserved");
+}
+
+done_testing;
@@ -0,0 +1,61 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use File::Temp;
+
+# builds forked into the background with PERL_FMC_BACKGROUND
+
+use Config;
+$Config{d_fork}
+  or skip_all "no fork()";
+
+my $cache = File::Temp->newdir;
+local $ENV{PERL_FMC_BACKGROUND} = 1;
+local $ENV{PERL_FMC_CACHE} = "$cache";
+
+my $code = <<'EOS';
+use v5.42;
+use Faster::Maths::CC;
+
+sub calc ($x) {
+    return $x * $x + $x * 2 - 1;
+}
+
+# nothing's been loaded before the first call into a fragment polls
+# for the build
+print "loaded ", $INC{"Faster/Maths/CC/Compiled.pm"} ? 1 : 0, "\n";
+calc(1) == 2
+  or die "bad early result\n";
+
+# wait for the build to finish, the next poll loads it
+1 until waitpid(-1, 0) == -1;
+my $start = time;
+my $calls = 0;
+until ($INC{"Faster/Maths/CC/Compiled.pm"}) {
+    calc($calls) == $calls * $calls + $calls * 2 - 1
+      or die "bad result for $calls\n";
+    ++$calls;
+    time - $start < 60
+      or die "timed out waiting for the module to load\n";
+}
+print "result ", calc(5), "\n";
+EOS
+
+my $first = run($code);
+like($first, qr/^loaded 0$/m, "ran before the build finished");
+like($first, qr/^result 34$/m, "compiled result");
+
+my $second = run($code);
+like($second, qr/^loaded 1$/m, "cached build loaded at start");
+like($second, qr/^result 34$/m, "compiled result from cache");
+
+done_testing;
+
+sub run ($code) {
+    open my $fh, "-|", $^X, (map "-I$_", @INC), "-e", $code
+      or die "Cannot run perl: $!";
+    my $out = do { local $/; <$fh> };
+    close $fh;
+    is($?, 0, "child perl succeeded");
+    return $out;
+}
@@ -0,0 +1,52 @@
+#!perl
+use v5.42;
+use Test2::V0;
+use Config;
+use File::Temp;
+use Faster::Maths::CC (); # CHECK time build, but not enabled here
+
+# each build backend, using late builds so the backend can be changed
+# between builds
+
+local $ENV{PERL_FMC_CACHE} = "";
+
+my $count = 0;
+for my $backend (qw(make cc)) {
+    local $ENV{PERL_FMC_BACKEND} = $backend;
+    my $sub = eval 'use Faster::Maths::CC; sub ($x) { $x * $x - $x * 2 }'
+      or die $@;
+    is($sub->(5), 15, "$backend: result");
+    ++$count;
+    my $file = "Faster/Maths/CC/Compiled$count.pm";
+    ok($INC{$file}, "$backend: built and loaded");
+    if ($backend eq "cc") {
+        like($INC{$file}, qr/\.\Q$Config{dlext}\E$/,
+             "$backend: loaded the shared object directly");
+    }
+}
+
+{
+    # the paths are quoted for the shell
+    my $tmp = File::Temp->newdir;
+    local $ENV{PERL_FMC_CACHE} = "$tmp/with space";
+    local $ENV{PERL_FMC_BACKEND} = "cc";
+    my $sub = eval 'use Faster::Maths::CC; sub ($x) { $x * $x + $x * 4 }'
+      or die $@;
+    is($sub->(2), 12, "cc: result with a space in the path");
+    ++$count;
+    like($INC{"Faster/Maths/CC/Compiled$count.pm"}, qr/with space/,
+         "cc: built and loaded with a space in the path");
+}
+
+{
+    local $ENV{PERL_FMC_BACKEND} = "unknown";
+    my @warn;
+    local $SIG{__WARN__} = sub { push @warn, @_ };
+    my $sub = eval 'use Faster::Maths::CC; sub ($x) { $x * 3 - $x * 2 }'
+      or die $@;
+    is($sub->(5), 5, "unknown backend: result from the original ops");
+    like($warn[0], qr/Unknown PERL_FMC_BACKEND unknown/,
+         "unknown backend: warned");
+}
+
+done_testing;
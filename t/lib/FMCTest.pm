@@ -0,0 +1,61 @@
+package FMCTest;
+use v5.42;
+use Exporter "import";
+
+our @EXPORT_OK = qw(mode_subs code dump_code);
+
+# the pragma combinations that change the generated code
+my %modes =
+  (
+    "default" => "use Faster::Maths::CC;",
+    "noov" => "use Faster::Maths::CC; no overloading;",
+    "ovfloat" => 'use Faster::Maths::CC "+float";',
+    "float" => 'use Faster::Maths::CC "+float"; no overloading;',
+    "integer" => "use Faster::Maths::CC; use integer;",
+    "integer noov" => "use Faster::Maths::CC; use integer; no overloading;",
+  );
+
+# compile $body as a sub for each of the named modes, and again with
+# the same pragmas but without Faster::Maths::CC to compare against.
+#
+# Returns [ name, compiled sub, perl sub ] for each mode.
+#
+# Call this at BEGIN time so the subs are compiled before CHECK.
+sub mode_subs ($body, @names) {
+    my $package = caller;
+    my @subs;
+    for my $name (@names) {
+        my $pragmas = $modes{$name}
+          or die "Unknown mode $name";
+        (my $perl_pragmas = $pragmas) =~ s/use Faster::Maths::CC[^;]*;//;
+        push @subs,
+          [
+            $name,
+            (eval "package $package; sub { $pragmas\n$body }" or die $@),
+            (eval "package $package; sub { $perl_pragmas\n$body }"
+               or die $@),
+          ];
+    }
+    return @subs;
+}
+
+# the generated code of the one fragment matching $re
+sub code ($re) {
+    my @found = grep $_->[0] =~ $re, @Faster::Maths::CC::collection;
+    if (@found != 1) {
+        dump_code();
+        die "Expected one fragment matching $re, found ", scalar @found,
+          "\n", map "$_->[3]: $_->[2]\n", @found;
+    }
+    return $found[0][0];
+}
+
+# all the generated code, for diagnosing failures
+sub dump_code {
+    for my $code (@Faster::Maths::CC::collection) {
+        print STDERR "\n\n** $code->[3]: $code->[2] **\n";
+        print STDERR "  $_\n" for split /\n/, $code->[0];
+    }
+}
+
+1;